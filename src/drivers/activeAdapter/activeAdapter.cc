@@ -3,12 +3,46 @@
 #include "../../utils/log.hpp"
 #include "../../utils/utils.hpp"
 
+#include "md5.h"
+#include <optional>
+#include <set>
+
+#define CREATE_INCOMING_CHAPTER_TABLE_SQL                                      \
+  R"(CREATE TEMP TABLE IF NOT EXISTS "INCOMING_CHAPTER" ("ID" VARCHAR(255) NOT NULL PRIMARY KEY, "IDX" INTEGER NOT NULL, "TITLE" VARCHAR(255) NOT NULL, "IS_EXTRA" INTEGER NOT NULL);)"
+
+#define UPSERT_INCOMING_CHAPTERS_SQL                                           \
+  R"(INSERT INTO CHAPTER (MANGA_ID, ID, IDX, TITLE, IS_EXTRA) SELECT :manga_id, ID, IDX, TITLE, IS_EXTRA FROM temp.INCOMING_CHAPTER WHERE true ON CONFLICT (MANGA_ID, ID) DO UPDATE SET IDX = excluded.IDX, TITLE = excluded.TITLE, IS_EXTRA = excluded.IS_EXTRA WHERE IDX != excluded.IDX OR TITLE != excluded.TITLE OR IS_EXTRA != excluded.IS_EXTRA)"
+
+// The interval between the polls of the updates before any update is seen in
+// seconds.
+#define DEFAULT_UPDATE_INTERVAL 600
+
+// The shortest interval between the refreshes of a chapter triggered by the
+// rejected images in seconds.
+#define MIN_REFRESH_INTERVAL 60
+
+// The delay before a failed page of the backfill is walked again in seconds.
+#define BACKFILL_RETRY_DELAY 30
+
 #define CHECK_ONLINE()                                                         \
   if (!isOnline)                                                               \
     throw "Database is offline";
 
+// Return the hash of the content of the manga that is written into the
+// database.
+static string contentHashOf(DetailsManga *manga) {
+  json content = manga->toJson();
+  content.erase("updateTime");
+  content["extraData"] = manga->chapters.extraData;
+
+  return MD5()(content.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
 ActiveAdapter::ActiveAdapter(ActiveDriver *driver) : driver(driver) {
   id = driver->id;
+  minUpdateInterval = driver->minUpdateInterval;
+  maxUpdateInterval = driver->maxUpdateInterval;
+  urlTtl = driver->urlTtl;
   proxyHeaders = driver->proxyHeaders;
   supportedGenres = driver->supportedGenres;
   version = driver->version;
@@ -28,41 +62,157 @@ ActiveAdapter::~ActiveAdapter() {
 vector<string> ActiveAdapter::getChapter(string id, string extraData) {
   CHECK_ONLINE()
 
-  session sql(*pool);
-  string urls;
-  indicator ind;
-  sql << "SELECT URLS FROM CHAPTER WHERE ID = :id AND MANGA_ID = :manga_id",
-      into(urls, ind), use(id), use(extraData);
-
-  if (ind == i_null) {
-    string proxy;
-    if (proxies.size() >= 2) {
-      if (proxyCount < 1 || proxyCount >= proxies.size())
-        proxyCount = 1;
-
-      proxy = proxies.at(proxyCount);
-      unique_lock<std::mutex> guard(mutex);
-      proxyCount++;
-      guard.unlock();
-    }
+  // there is a row only if the urls have been fetched, its REF is null if the
+  // chapter has no images
+  bool fetched = false;
+  int resolvedTime = 0;
+  vector<string> refs;
+  statements.query(
+      *pool,
+      "SELECT I.REF, C.RESOLVED_TIME FROM CHAPTER C LEFT JOIN CHAPTER_IMAGE I "
+      "ON I.MANGA_ID = C.MANGA_ID AND I.CHAPTER_ID = C.ID WHERE C.ID = :id "
+      "AND C.MANGA_ID = :manga_id AND C.URLS IS NOT NULL ORDER BY I.IDX",
+      {id, extraData}, [&](const row &row) {
+        fetched = true;
+        if (row.get_indicator("REF") != i_null)
+          refs.push_back(row.get<string>("REF"));
+        if (row.get_indicator("RESOLVED_TIME") != i_null)
+          resolvedTime = row.get<int>("RESOLVED_TIME");
+      });
+
+  // serve the stale urls and refresh them in the background
+  long long now = chrono::duration_cast<chrono::seconds>(
+                      chrono::system_clock::now().time_since_epoch())
+                      .count();
+  if (fetched && urlTtl > 0 && now - resolvedTime >= urlTtl)
+    queue.push({CrawlChapter, id, extraData}, CRAWL_PRIORITY_REFRESH);
+
+  if (!fetched) {
+    // the readers don't wait for the rate budget
+    return fetchChapter(id, extraData, proxyPool.select());
+  } else {
+    return refs;
+  }
+}
 
-    vector<string> result = driver->getChapter(id, extraData, proxy);
+vector<string> ActiveAdapter::fetchChapter(const string &id,
+                                           const string &extraData,
+                                           const string &proxy) {
+  // a prefetch and a reader may fetch the same chapter at the same time
+  return chapterFetches.run(fmt::format("{}\u001D{}", id, extraData), [&] {
+    return storeChapter(id, extraData, proxyPool.track(proxy, [&] {
+      return driver->getChapter(id, extraData, proxy);
+    }));
+  });
+}
 
-    sql << fmt::format("UPDATE CHAPTER SET URLS = '{}' WHERE ID = :id AND "
-                       "MANGA_ID = :manga_id",
-                       fmt::join(result, "|")),
-        use(id), use(extraData);
+vector<string> ActiveAdapter::storeChapter(const string &id,
+                                           const string &extraData,
+                                           vector<string> result) {
+  session sql(*pool);
+  transaction tr(sql);
+
+  // replace the urls fetched by a concurrent request
+  sql << "DELETE FROM CHAPTER_IMAGE WHERE MANGA_ID = :manga_id AND "
+         "CHAPTER_ID = :id",
+      use(extraData), use(id);
+  appendChapterImages(sql, id, extraData, result);
+  sql << "UPDATE CHAPTER SET URLS = '', RESOLVED_TIME = :resolved_time WHERE "
+         "ID = :id AND MANGA_ID = :manga_id",
+      use(chrono::duration_cast<chrono::seconds>(
+              chrono::system_clock::now().time_since_epoch())
+              .count()),
+      use(id), use(extraData);
+
+  tr.commit();
+
+  return result;
+}
 
-    return result;
-  } else {
-    return split(urls, R"(\|)");
+void ActiveAdapter::onImageRejected(const string &url) {
+  if (!isOnline || pool == nullptr)
+    return;
+
+  // every image of the chapter may be rejected, refresh it once in a while
+  long long before = chrono::duration_cast<chrono::seconds>(
+                         chrono::system_clock::now().time_since_epoch())
+                         .count() -
+                     MIN_REFRESH_INTERVAL;
+  // the chapter is queued after the session is returned
+  optional<CrawlJob> job;
+  try {
+    statements.query(
+        *pool,
+        "SELECT I.MANGA_ID, I.CHAPTER_ID FROM CHAPTER_IMAGE I JOIN CHAPTER C "
+        "ON C.MANGA_ID = I.MANGA_ID AND C.ID = I.CHAPTER_ID WHERE I.REF = :ref "
+        "AND COALESCE(C.RESOLVED_TIME, 0) < :before LIMIT 1",
+        {url, before}, [&](const row &row) {
+          job = CrawlJob{CrawlChapter, row.get<string>("CHAPTER_ID"),
+                         row.get<string>("MANGA_ID")};
+        });
+  } catch (...) {
+    log(fmt::format("ActiveDriver - {}", this->id),
+        "Failed to Find the Rejected Image");
+    return;
   }
+
+  if (job)
+    queue.push(*job, CRAWL_PRIORITY_REFRESH);
+}
+
+void ActiveAdapter::startBackfill(bool restart) {
+  if (backfillShare <= 0)
+    throw "Backfill is disabled";
+
+  backfill.start(restart);
+}
+
+void ActiveAdapter::stopBackfill() { backfill.stop(); }
+
+json ActiveAdapter::getBackfill() { return backfill.getStats(); }
+
+json ActiveAdapter::getStats() {
+  json stats = LocalDriver::getStats();
+  stats["crawlQueue"] = queue.getStats();
+
+  if (poller != nullptr)
+    stats["updatePoller"] = {
+        {"nextPoll", poller->getNextPoll()},
+        {"estimatedInterval", poller->getEstimatedInterval()},
+        {"failures", poller->getFailures()}};
+
+  stats["proxies"] = proxyPool.getStats();
+  stats["backfill"] = backfill.getStats();
+  stats["unchangedCrawls"] = unchangedCrawls.load();
+
+  return stats;
 }
 
 void ActiveAdapter::applyConfig(json config) {
   if (config.contains("proxies"))
     proxies = config["proxies"].get<vector<string>>();
 
+  if (config.contains("crawlWorkers"))
+    crawlWorkers = config["crawlWorkers"].get<int>();
+
+  if (config.contains("crawlRate"))
+    crawlRate = config["crawlRate"].get<double>();
+
+  if (config.contains("minUpdateInterval"))
+    minUpdateInterval = config["minUpdateInterval"].get<int>();
+
+  if (config.contains("maxUpdateInterval"))
+    maxUpdateInterval = config["maxUpdateInterval"].get<int>();
+
+  if (config.contains("urlTtl"))
+    urlTtl = config["urlTtl"].get<int>();
+
+  if (config.contains("backfillShare"))
+    backfillShare = config["backfillShare"].get<double>();
+
+  if (config.contains("prefetchChapters"))
+    prefetchChapters = config["prefetchChapters"].get<int>();
+
   LocalDriver::applyConfig(config);
 
   // pass through the config
@@ -78,166 +228,299 @@ void ActiveAdapter::mainLoop() {
 
   initializeDatabase();
 
-  // read the state
-  ifstream inFile("../data/" + id + ".json");
-  if (inFile.is_open()) {
-    try {
-      json state;
-      inFile >> state;
-      waitingList = state["waitingList"].get<vector<string>>();
-    } catch (...) {
+  try {
+    queue.open(pool, &statements, "../data/" + id + ".json");
+  } catch (...) {
+    log(fmt::format("ActiveDriver - {}", this->id),
+        "Failed to Open the Crawl Queue");
+    return;
+  }
+
+  // the workers share the proxies, each proxy has its own rate budget
+  double rate = crawlRate > 0 ? crawlRate / 60 : 1.0 / driver->timeout;
+  for (const auto &proxy : proxies)
+    proxyPool.add(proxy, rate);
+  if (proxies.empty())
+    proxyPool.add("", rate);
+
+  int workers = crawlWorkers > 0 ? crawlWorkers : max<int>(proxies.size(), 1);
+  for (int i = 0; i < workers; i++)
+    thread(&ActiveAdapter::crawlLoop, this).detach();
+
+  // walk the whole list first, then every genre by status to reach the manga
+  // beyond the last page of the whole list
+  vector<BackfillSegment> segments = {{All, Any}};
+  for (Genre genre : driver->supportedGenres)
+    if (genre != All) {
+      segments.push_back({genre, OnGoing});
+      segments.push_back({genre, Ended});
     }
+
+  try {
+    backfill.open(pool, &statements, segments);
+  } catch (...) {
+    log(fmt::format("ActiveDriver - {}", this->id),
+        "Failed to Open the Backfill");
   }
-  inFile.close();
 
-  string proxy;
-  if (proxies.size() >= 1)
-    proxy = proxies.at(0);
+  if (backfillShare > 0) {
+    backfillBucket = new TokenBucket(
+        backfillShare * rate * max<int>(proxies.size(), 1));
+    thread(&ActiveAdapter::backfillLoop, this).detach();
+  }
 
-  json state;
-  string id;
+  poller = new UpdatePoller(minUpdateInterval, maxUpdateInterval,
+                            DEFAULT_UPDATE_INTERVAL);
 
   while (true) {
-    // check if any updates every 5 minutes
-    if (counter >= 300) {
-      vector<PreviewManga> manga;
+    if (poller->isDue()) {
       try {
-        log(fmt::format("ActiveDriver - {}", this->id), "Getting Updates");
-        manga = driver->getUpdates(proxy);
+        pollUpdates(proxyPool.acquire());
       } catch (...) {
         log(fmt::format("ActiveDriver - {}", this->id),
-            "Failed to Get Updates");
-        continue;
+            "Failed to Check Updates");
+        poller->failed();
       }
+    }
 
-      map<string, string> latestMap;
-      ostringstream oss;
-      oss << "'";
-      for (size_t i = 0; i < manga.size(); ++i) {
-        oss << manga[i].id;
-        latestMap[manga[i].id] = manga[i].latest;
-        if (i < manga.size() - 1)
-          oss << "', '";
-      }
-      oss << "'";
+    this_thread::sleep_for(chrono::seconds(1));
+  }
+}
 
-      session sql(*pool);
-      rowset<row> rs = sql.prepare << fmt::format(
-                           "SELECT * FROM MANGA WHERE ID IN ({})", oss.str());
+void ActiveAdapter::pollUpdates(const string &proxy) {
+  vector<PreviewManga> manga;
+  try {
+    log(fmt::format("ActiveDriver - {}", this->id), "Getting Updates");
+    manga = proxyPool.track(proxy, [&] { return driver->getUpdates(proxy); });
+  } catch (...) {
+    log(fmt::format("ActiveDriver - {}", this->id), "Failed to Get Updates");
+    poller->failed();
+    return;
+  }
 
-      for (auto it = rs.begin(); it != rs.end(); it++) {
-        const row &row = *it;
+  map<string, string> latestMap;
+  vector<string> ids;
+  for (const auto &preview : manga) {
+    latestMap[preview.id] = preview.latest;
+    ids.push_back(preview.id);
+  }
 
-        id = row.get<string>("ID");
+  // the manga are queued after the session is returned
+  vector<string> changed;
+  statements.query(*pool,
+                   "SELECT ID, LATEST FROM MANGA WHERE ID IN (SELECT value "
+                   "FROM json_each(:ids))",
+                   {json(ids).dump()}, [&](const row &row) {
+                     string id = row.get<string>("ID");
+
+                     // check if updated
+                     if (!this->driver->isLatestEqual(
+                             row.get<string>("LATEST"), latestMap[id]))
+                       changed.push_back(id);
+
+                     latestMap.erase(id);
+                   });
+
+  // if not found in database
+  for (const auto &pair : latestMap)
+    changed.push_back(pair.first);
+
+  // only the newly queued manga count as a change, the ones still waiting to
+  // be crawled differ from the database on every poll
+  int updated = 0;
+  for (const auto &id : changed)
+    if (queue.push({CrawlManga, id}, CRAWL_PRIORITY_UPDATE))
+      updated++;
+
+  poller->succeeded(updated > 0);
+}
 
-        // check if updated and not in the waiting list
-        if (!this->driver->isLatestEqual(row.get<string>("LATEST"),
-                                         latestMap[id]) &&
-            find(waitingList.begin(), waitingList.end(), id) ==
-                waitingList.end())
-          waitingList.insert(waitingList.begin(), id);
+void ActiveAdapter::crawlLoop() {
+  while (true) {
+    CrawlJob job;
+    if (!queue.pop(job)) {
+      this_thread::sleep_for(chrono::seconds(1));
+      continue;
+    }
 
-        latestMap.erase(id);
+    // pick the healthiest proxy with some rate budget left
+    string proxy = proxyPool.acquire();
+    try {
+      if (job.kind == CrawlManga) {
+        crawl(job.id, proxy);
+        prefetch(job.id);
+      } else {
+        fetchChapter(job.id, job.extraData, proxy);
       }
 
-      // if not found in database
-      for (const auto &pair : latestMap)
-        waitingList.insert(waitingList.begin(), pair.first);
+      queue.complete(job);
+    } catch (...) {
+      log(fmt::format("ActiveDriver - {}", this->id),
+          fmt::format("Failed to Get {}", job.id));
+      queue.retry(job);
+    }
+  }
+}
 
-      // reset counter
-      counter = 0;
-    } else if (!waitingList.empty()) {
-      id = waitingList.back();
-      waitingList.pop_back();
-      try {
-        log(fmt::format("ActiveDriver - {}", this->id),
-            fmt::format("Getting {}", id));
-        DetailsManga *manga =
-            (DetailsManga *)driver->getManga({id}, true, proxy).at(0);
-
-        ostringstream genres;
-        for (size_t i = 0; i < manga->genres.size(); ++i) {
-          genres << genreToString(manga->genres[i]);
-          if (i < manga->genres.size() - 1)
-            genres << "|";
-        }
-
-        session sql(*pool);
-        transaction tr(sql);
-
-        // update the manga info
-        sql << "REPLACE INTO MANGA (ID, THUMBNAIL, TITLE, DESCRIPTION, "
-               "IS_ENDED, AUTHORS, GENRES, LATEST, UPDATE_TIME, "
-               "EXTRA_DATA) VALUES (:id, :thumbnail, :title, :description, "
-               ":is_ended, :authors, :genres, :latest, :update_time, "
-               ":extras_data)",
-            use(manga->id), use(manga->thumbnail), use(manga->title),
-            use(manga->description), use((int)manga->isEnded),
-            use(fmt::format("{}", fmt::join(manga->authors, "|"))),
-            use(genres.str()), use(manga->latest),
-            use(chrono::duration_cast<chrono::seconds>(
-                    chrono::system_clock::now().time_since_epoch())
-                    .count()),
-            use(manga->chapters.extraData);
-
-        auto updateChapter = [&](vector<Chapter> chapters, bool isExtra) {
-          ostringstream oss;
-          map<string, int> chaptersMap;
-          oss << "'";
-          for (size_t i = 0; i < chapters.size(); ++i) {
-            oss << chapters[i].id;
-            chaptersMap[chapters[i].id] = i;
-            if (i < chapters.size() - 1)
-              oss << "', '";
-          }
-          oss << "'";
-
-          // remove the deleted chapter
-          sql << fmt::format("DELETE FROM CHAPTER WHERE MANGA_ID = :manga_id "
-                             "AND IS_EXTRA = :is_extra AND ID NOT IN ({})",
-                             oss.str()),
-              use(manga->id), use((int)isExtra);
-
-          // insert only the new one
-          rowset<row> rs =
-              (sql.prepare << "SELECT ID FROM CHAPTER WHERE MANGA_ID = "
-                              ":manga_id AND IS_EXTRA = :is_extra",
-               use(manga->id), use((int)isExtra));
-          for (auto it = rs.begin(); it != rs.end(); it++) {
-            const row &row = *it;
-            chaptersMap.erase(row.get<string>("ID"));
-          }
-
-          for (const auto &pair : chaptersMap) {
-            Chapter chapter = chapters[pair.second];
-
-            sql << "REPLACE INTO CHAPTER (MANGA_ID, ID, IDX, TITLE, "
-                   "IS_EXTRA) VALUES (:manga_id, :id, :idx, :title, "
-                   ":is_extra)",
-                use(manga->id), use(chapter.id),
-                use((int)(chapters.size() - pair.second - 1)),
-                use(chapter.title), use((int)isExtra);
-          }
-        };
-
-        updateChapter(manga->chapters.serial, false);
-        updateChapter(manga->chapters.extra, true);
-
-        tr.commit();
-      } catch (...) {
+void ActiveAdapter::crawl(const string &id, const string &proxy) {
+  log(fmt::format("ActiveDriver - {}", this->id),
+      fmt::format("Getting {}", id));
+  vector<Manga *> result = proxyPool.track(
+      proxy, [&] { return driver->getManga({id}, true, proxy); });
+  unique_ptr<DetailsManga> manga((DetailsManga *)result.at(0));
+
+  // skip the write if nothing changed, so the manga keeps its place in the list
+  string contentHash = contentHashOf(manga.get());
+  bool unchanged = false;
+  statements.query(
+      *pool, "SELECT CONTENT_HASH FROM MANGA WHERE ID = :id", {manga->id},
+      [&](const row &row) {
+        unchanged = row.get_indicator("CONTENT_HASH") != i_null &&
+                    row.get<string>("CONTENT_HASH") == contentHash;
+      });
+
+  if (unchanged) {
+    unchangedCrawls++;
+    return;
+  }
+
+  ostringstream genres;
+  for (size_t i = 0; i < manga->genres.size(); ++i) {
+    genres << genreToString(manga->genres[i]);
+    if (i < manga->genres.size() - 1)
+      genres << "|";
+  }
+
+  session sql(*pool);
+
+  // stage the chapters in a temporary table with a single bulk insert, before
+  // the transaction so it only holds the lock for the diff
+  vector<string> chapterIds, chapterTitles;
+  vector<int> chapterIndexes, chapterIsExtra;
+  for (const auto *chapters :
+       {&manga->chapters.serial, &manga->chapters.extra}) {
+    bool isExtra = chapters == &manga->chapters.extra;
+
+    for (size_t i = 0; i < chapters->size(); i++) {
+      chapterIds.push_back(chapters->at(i).id);
+      chapterTitles.push_back(chapters->at(i).title);
+      chapterIndexes.push_back(chapters->size() - i - 1);
+      chapterIsExtra.push_back(isExtra);
+    }
+  }
+
+  sql << CREATE_INCOMING_CHAPTER_TABLE_SQL;
+  sql << "DELETE FROM temp.INCOMING_CHAPTER";
+  if (!chapterIds.empty())
+    sql << "INSERT OR REPLACE INTO temp.INCOMING_CHAPTER (ID, IDX, TITLE, "
+           "IS_EXTRA) VALUES (:id, :idx, :title, :is_extra)",
+        use(chapterIds), use(chapterIndexes), use(chapterTitles),
+        use(chapterIsExtra);
+
+  transaction tr(sql);
+
+  // update the manga info
+  sql << "REPLACE INTO MANGA (ID, THUMBNAIL, TITLE, DESCRIPTION, "
+         "IS_ENDED, AUTHORS, GENRES, GENRE_MASK, LATEST, UPDATE_TIME, "
+         "EXTRA_DATA, CONTENT_HASH) VALUES (:id, :thumbnail, :title, "
+         ":description, :is_ended, :authors, :genres, :genre_mask, :latest, "
+         ":update_time, :extras_data, :content_hash)",
+      use(manga->id), use(manga->thumbnail), use(manga->title),
+      use(manga->description), use((int)manga->isEnded),
+      use(fmt::format("{}", fmt::join(manga->authors, "|"))),
+      use(genres.str()), use(genresToMask(manga->genres)),
+      use(manga->latest),
+      use(chrono::duration_cast<chrono::seconds>(
+              chrono::system_clock::now().time_since_epoch())
+              .count()),
+      use(manga->chapters.extraData), use(contentHash);
+
+  // remove the deleted chapters and upsert the rest, the fetched urls are kept
+  sql << "DELETE FROM CHAPTER WHERE MANGA_ID = :manga_id AND ID NOT IN "
+         "(SELECT ID FROM temp.INCOMING_CHAPTER)",
+      use(manga->id);
+  sql << UPSERT_INCOMING_CHAPTERS_SQL, use(manga->id);
+
+  // remove the images of the deleted chapters
+  sql << "DELETE FROM CHAPTER_IMAGE WHERE MANGA_ID = :manga_id AND "
+         "CHAPTER_ID NOT IN (SELECT ID FROM CHAPTER WHERE MANGA_ID = "
+         ":manga_id)",
+      use(manga->id);
+
+  tr.commit();
+  onMangaChanged(manga->id);
+}
+
+void ActiveAdapter::prefetch(const string &id) {
+  if (prefetchChapters <= 0)
+    return;
+
+  // queue the newest serial chapters whose urls are not fetched yet, after
+  // the session is returned
+  vector<string> chapterIds;
+  try {
+    statements.query(*pool,
+                     "SELECT ID FROM (SELECT ID, URLS FROM CHAPTER WHERE "
+                     "MANGA_ID = :manga_id AND IS_EXTRA = 0 ORDER BY IDX DESC "
+                     "LIMIT :limit) WHERE URLS IS NULL",
+                     {id, (long long)prefetchChapters}, [&](const row &row) {
+                       chapterIds.push_back(row.get<string>("ID"));
+                     });
+  } catch (...) {
+    log(fmt::format("ActiveDriver - {}", this->id),
+        fmt::format("Failed to Prefetch {}", id));
+    return;
+  }
+
+  for (const auto &chapterId : chapterIds)
+    queue.push({CrawlChapter, chapterId, id}, CRAWL_PRIORITY_PREFETCH);
+}
+
+void ActiveAdapter::backfillLoop() {
+  while (true) {
+    BackfillSegment segment;
+    int page;
+    if (!backfill.next(segment, page)) {
+      this_thread::sleep_for(chrono::seconds(1));
+      continue;
+    }
+
+    // the pages and the manga found on them share the budget of the backfill
+    backfillBucket->acquire();
+    string proxy = proxyPool.acquire();
+
+    vector<string> ids;
+    set<string> missing;
+    try {
+      vector<Manga *> manga = proxyPool.track(proxy, [&] {
+        return driver->getList(segment.genre, page, segment.status, proxy);
+      });
+      for (const auto *item : manga)
+        ids.push_back(item->id);
+      releaseMemory(manga);
+
+      missing.insert(ids.begin(), ids.end());
+      statements.query(*pool,
+                       "SELECT ID FROM MANGA WHERE ID IN (SELECT value FROM "
+                       "json_each(:ids))",
+                       {json(ids).dump()}, [&](const row &row) {
+                         missing.erase(row.get<string>("ID"));
+                       });
+    } catch (...) {
+      log(fmt::format("ActiveDriver - {}", this->id),
+          fmt::format("Failed to Backfill Page {}", page));
+      if (backfill.fail())
         log(fmt::format("ActiveDriver - {}", this->id),
-            fmt::format("Failed to Get {}", id));
-        waitingList.insert(waitingList.begin(), id);
-      }
+            fmt::format("Skipped Backfill Page {}", page));
+      this_thread::sleep_for(chrono::seconds(BACKFILL_RETRY_DELAY));
+      continue;
     }
 
-    // save state
-    state["waitingList"] = waitingList;
-    ofstream outFile("../data/" + this->id + ".json");
-    outFile << state;
-    outFile.close();
+    for (const auto &id : missing) {
+      backfillBucket->acquire();
+      queue.push({CrawlManga, id}, CRAWL_PRIORITY_BACKFILL);
+    }
 
-    counter += driver->timeout;
-    this_thread::sleep_for(chrono::seconds(driver->timeout));
+    backfill.advance(ids.size(), missing.size());
   }
 }
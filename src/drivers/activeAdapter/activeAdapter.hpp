@@ -2,6 +2,11 @@
 
 #include "../../models/activeDriver.hpp"
 #include "../../models/localDriver.hpp"
+#include "../../utils/proxyPool.hpp"
+#include "../../utils/singleFlight.hpp"
+#include "../../utils/updatePoller.hpp"
+#include "backfill.hpp"
+#include "crawlQueue.hpp"
 
 // This is the adapter of the ActiveDriver. It will handles the updates and
 // caching of the database.
@@ -11,17 +16,71 @@ public:
 
   vector<string> getChapter(string id, string extraData) override;
 
+  void onImageRejected(const string &url) override;
+
+  json getStats() override;
+
+  // Start walking the lists of the source for the missing manga. The last
+  // walk is resumed unless restart is true.
+  void startBackfill(bool restart);
+
+  // Pause the walk of the lists.
+  void stopBackfill();
+
+  json getBackfill();
+
   void applyConfig(json config) override;
 
   ~ActiveAdapter();
 
 private:
   ActiveDriver *driver;
-  int counter = 300;
-  vector<string> waitingList;
+  // The bounds of the interval between the polls of the updates in seconds.
+  int minUpdateInterval;
+  int maxUpdateInterval;
+  // How long the urls of a chapter stay fresh in seconds, 0 means forever.
+  int urlTtl;
+  UpdatePoller *poller = nullptr;
+  CrawlQueue queue;
   vector<string> proxies;
-  int proxyCount = 0;
-  std::mutex mutex;
+  ProxyPool proxyPool;
+  // The number of crawl workers, 0 means one per proxy.
+  int crawlWorkers = 0;
+  // The requests per minute of each proxy, 0 means one per driver->timeout.
+  double crawlRate = 0;
+  // The number of the newest chapters to be fetched after a manga is crawled.
+  int prefetchChapters = 0;
+  SingleFlight<vector<string>> chapterFetches;
+  Backfill backfill;
+  // The share of the rate budget of the proxies used by the backfill.
+  double backfillShare = 0.5;
+  TokenBucket *backfillBucket = nullptr;
+  // The number of crawled manga that were unchanged and not written.
+  atomic<unsigned long long> unchangedCrawls = 0;
 
   void mainLoop();
+
+  // Get the updates and queue the updated manga.
+  void pollUpdates(const string &proxy);
+
+  // Take the jobs from the queue and crawl them through the proxies.
+  void crawlLoop();
+
+  // Fetch the manga and write it into the database.
+  void crawl(const string &id, const string &proxy);
+
+  // Fetch the urls of the chapter and write them into the database.
+  vector<string> fetchChapter(const string &id, const string &extraData,
+                              const string &proxy);
+
+  // Write the urls of the chapter into the database and return them.
+  vector<string> storeChapter(const string &id, const string &extraData,
+                              vector<string> result);
+
+  // Queue the newest chapters of the manga to be fetched.
+  void prefetch(const string &id);
+
+  // Walk the lists of the source and queue the manga missing from the
+  // database.
+  void backfillLoop();
 };
\ No newline at end of file
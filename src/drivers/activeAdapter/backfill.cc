@@ -0,0 +1,155 @@
+#include "backfill.hpp"
+
+#include <chrono>
+
+#define CREATE_BACKFILL_TABLE_SQL                                              \
+  R"(CREATE TABLE IF NOT EXISTS "BACKFILL" ("ID" INTEGER NOT NULL PRIMARY KEY, "RUNNING" INTEGER NOT NULL, "SEGMENT" INTEGER NOT NULL, "PAGE" INTEGER NOT NULL, "PAGES" INTEGER NOT NULL, "FOUND" INTEGER NOT NULL, "QUEUED" INTEGER NOT NULL, "STARTED_TIME" INTEGER NOT NULL, "FINISHED_TIME" INTEGER NOT NULL);)"
+
+// There is only one row.
+#define SAVE_BACKFILL_SQL                                                      \
+  R"(REPLACE INTO BACKFILL (ID, RUNNING, SEGMENT, PAGE, PAGES, FOUND, QUEUED, STARTED_TIME, FINISHED_TIME) VALUES (0, :running, :segment, :page, :pages, :found, :queued, :started_time, :finished_time))"
+
+static long long now() {
+  return chrono::duration_cast<chrono::seconds>(
+             chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void Backfill::open(connection_pool *pool, StatementCache *statements,
+                    const vector<BackfillSegment> &segments) {
+  lock_guard<std::mutex> guard(mutex);
+  this->pool = pool;
+  this->statements = statements;
+  this->segments = segments;
+
+  session sql(*pool);
+  sql << CREATE_BACKFILL_TABLE_SQL;
+
+  rowset<row> rs = sql.prepare << "SELECT * FROM BACKFILL WHERE ID = 0";
+  for (auto it = rs.begin(); it != rs.end(); it++) {
+    const row &row = *it;
+
+    running = row.get<int>("RUNNING");
+    segment = row.get<int>("SEGMENT");
+    page = row.get<int>("PAGE");
+    pages = row.get<int>("PAGES");
+    found = row.get<int>("FOUND");
+    queued = row.get<int>("QUEUED");
+    startedTime = row.get<int>("STARTED_TIME");
+    finishedTime = row.get<int>("FINISHED_TIME");
+  }
+
+  // the segments change with the supported genres, the walk starts over if
+  // the position is beyond them
+  if (segment < 0 || segment >= segments.size() || page < 1) {
+    segment = 0;
+    page = 1;
+  }
+}
+
+void Backfill::start(bool restart) {
+  lock_guard<std::mutex> guard(mutex);
+  if (pool == nullptr)
+    throw "Backfill is not ready";
+
+  if (restart || finishedTime > 0 || startedTime == 0) {
+    segment = 0;
+    page = 1;
+    pages = 0;
+    found = 0;
+    queued = 0;
+    skipped = 0;
+    startedTime = now();
+    finishedTime = 0;
+  }
+
+  running = true;
+  attempts = 0;
+  save();
+}
+
+void Backfill::stop() {
+  lock_guard<std::mutex> guard(mutex);
+  if (pool == nullptr)
+    throw "Backfill is not ready";
+
+  running = false;
+  save();
+}
+
+bool Backfill::next(BackfillSegment &segment, int &page) {
+  lock_guard<std::mutex> guard(mutex);
+  if (!running)
+    return false;
+
+  segment = segments[this->segment];
+  page = this->page;
+
+  return true;
+}
+
+void Backfill::advance(int found, int queued) {
+  lock_guard<std::mutex> guard(mutex);
+  // paused while the page was walked
+  if (!running)
+    return;
+
+  attempts = 0;
+  pages++;
+  this->found += found;
+  this->queued += queued;
+
+  if (found > 0) {
+    page++;
+  } else if (++segment < segments.size()) {
+    page = 1;
+  } else {
+    running = false;
+    finishedTime = now();
+  }
+
+  save();
+}
+
+bool Backfill::fail() {
+  lock_guard<std::mutex> guard(mutex);
+  if (!running || ++attempts < BACKFILL_MAX_ATTEMPTS)
+    return false;
+
+  // the page may never load, go on to the next one
+  attempts = 0;
+  skipped++;
+  page++;
+  save();
+
+  return true;
+}
+
+json Backfill::getStats() {
+  lock_guard<std::mutex> guard(mutex);
+
+  json stats = {{"running", running},
+                {"segment", segment},
+                {"segments", segments.size()},
+                {"page", page},
+                {"pages", pages},
+                {"found", found},
+                {"queued", queued},
+                {"skipped", skipped},
+                {"startedTime", startedTime},
+                {"finishedTime", finishedTime}};
+
+  if (segment < segments.size()) {
+    stats["genre"] = genreToString(segments[segment].genre);
+    stats["status"] = segments[segment].status;
+  }
+
+  return stats;
+}
+
+void Backfill::save() {
+  statements->execute(*pool, SAVE_BACKFILL_SQL,
+                      {(long long)running, (long long)segment, (long long)page,
+                       (long long)pages, (long long)found, (long long)queued,
+                       startedTime, finishedTime});
+}
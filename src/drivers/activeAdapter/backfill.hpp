@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../../models/common.hpp"
+#include "../../utils/statementCache.hpp"
+
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <soci/soci.h>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+using namespace std;
+using namespace soci;
+
+// The priority of the manga found by the backfill.
+#define CRAWL_PRIORITY_BACKFILL -2
+
+// The attempts at a page before it is skipped.
+#define BACKFILL_MAX_ATTEMPTS 5
+
+// A list walked by the backfill.
+struct BackfillSegment {
+  Genre genre;
+  Status status;
+};
+
+// This is the progress of walking the lists of the source to find the manga
+// missing from the database.
+// The lists are walked page by page, one segment after another. The position
+// is saved after every page, so the walk resumes in place after a restart.
+class Backfill {
+public:
+  // Load the progress from the database.
+  void open(connection_pool *pool, StatementCache *statements,
+            const vector<BackfillSegment> &segments);
+
+  // Start the walk, or resume it from the last position if it is not
+  // finished. It starts over if restart is true.
+  void start(bool restart);
+
+  // Pause the walk.
+  void stop();
+
+  // Get the next page to be walked. Return false if the walk is not running.
+  bool next(BackfillSegment &segment, int &page);
+
+  // Record the walked page. An empty page ends its segment.
+  void advance(int found, int queued);
+
+  // Record a failed attempt at the page. Return true if the page is skipped.
+  bool fail();
+
+  json getStats();
+
+private:
+  std::mutex mutex;
+  connection_pool *pool = nullptr;
+  StatementCache *statements = nullptr;
+  vector<BackfillSegment> segments;
+  bool running = false;
+  int segment = 0;
+  int page = 1;
+  // The failed attempts at the page, not saved.
+  int attempts = 0;
+  // The total of the walked pages, the manga on them, and the queued manga.
+  int pages = 0;
+  int found = 0;
+  int queued = 0;
+  // The skipped pages of this run, not saved.
+  int skipped = 0;
+  long long startedTime = 0;
+  long long finishedTime = 0;
+
+  void save();
+};
@@ -0,0 +1,287 @@
+#include "crawlQueue.hpp"
+#include "../../utils/log.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unordered_set>
+
+#define CREATE_CRAWL_QUEUE_TABLE_SQL                                           \
+  R"(CREATE TABLE IF NOT EXISTS "CRAWL_QUEUE" ("KIND" INTEGER NOT NULL, "ID" VARCHAR(255) NOT NULL, "EXTRA_DATA" VARCHAR(255) NOT NULL, "PRIORITY" INTEGER NOT NULL, "SEQ" INTEGER NOT NULL, "ATTEMPTS" INTEGER NOT NULL, "NEXT_ATTEMPT" INTEGER NOT NULL, PRIMARY KEY ("KIND", "ID", "EXTRA_DATA"));)"
+
+#define SAVE_CRAWL_ITEM_SQL                                                    \
+  R"(REPLACE INTO CRAWL_QUEUE (KIND, ID, EXTRA_DATA, PRIORITY, SEQ, ATTEMPTS, NEXT_ATTEMPT) VALUES (:kind, :id, :extra_data, :priority, :seq, :attempts, :next_attempt))"
+
+// The delay before the first retry in seconds, it doubles on every attempt.
+#define CRAWL_RETRY_DELAY 30
+// The longest delay between the retries in seconds.
+#define CRAWL_MAX_RETRY_DELAY 3600
+
+static long long now() {
+  return chrono::duration_cast<chrono::seconds>(
+             chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void CrawlQueue::open(connection_pool *pool, StatementCache *statements,
+                      const string &statePath) {
+  // the items are loaded before the lock is taken, the queue never waits for
+  // a session while holding it
+  // in the order of SEQ, so the ready lists keep it
+  vector<Item> loaded;
+  unordered_set<string> keys;
+  long long seq = 0;
+  {
+    session sql(*pool);
+    sql << CREATE_CRAWL_QUEUE_TABLE_SQL;
+
+    rowset<row> rs = sql.prepare << "SELECT * FROM CRAWL_QUEUE ORDER BY SEQ";
+    for (auto it = rs.begin(); it != rs.end(); it++) {
+      const row &row = *it;
+
+      Item item;
+      item.job = {(CrawlKind)row.get<int>("KIND"), row.get<string>("ID"),
+                  row.get<string>("EXTRA_DATA")};
+      item.priority = row.get<int>("PRIORITY");
+      item.seq = row.get<int>("SEQ");
+      item.attempts = row.get<int>("ATTEMPTS");
+      item.nextAttempt = row.get<int>("NEXT_ATTEMPT");
+      seq = max(seq, item.seq + 1);
+
+      keys.insert(keyOf(item.job));
+      loaded.push_back(item);
+    }
+
+    // import the waiting list of the old state file
+    ifstream inFile(statePath);
+    if (inFile.is_open()) {
+      try {
+        json state;
+        inFile >> state;
+        vector<string> waitingList =
+            state["waitingList"].get<vector<string>>();
+        inFile.close();
+
+        // the old list was taken from the back
+        transaction tr(sql);
+        for (auto it = waitingList.rbegin(); it != waitingList.rend(); it++) {
+          CrawlJob job = {CrawlManga, *it, ""};
+          if (!keys.insert(keyOf(job)).second)
+            continue;
+
+          Item &item =
+              loaded.emplace_back(Item{job, CRAWL_PRIORITY_UPDATE, seq++});
+          int kind = job.kind;
+          sql << SAVE_CRAWL_ITEM_SQL, use(kind), use(job.id),
+              use(job.extraData), use(item.priority), use(item.seq),
+              use(item.attempts), use(item.nextAttempt);
+        }
+        tr.commit();
+
+        filesystem::remove(statePath);
+      } catch (...) {
+        log("CrawlQueue", "Failed to Import the Waiting List");
+      }
+    }
+  }
+
+  lock_guard<std::mutex> guard(mutex);
+  this->pool = pool;
+  this->statements = statements;
+  nextSeq = seq;
+
+  for (const auto &item : loaded) {
+    string key = keyOf(item.job);
+    schedule(key, items[key] = item);
+  }
+
+  thread(&CrawlQueue::writeLoop, this).detach();
+}
+
+bool CrawlQueue::push(const CrawlJob &job, int priority) {
+  lock_guard<std::mutex> guard(mutex);
+  if (pool == nullptr)
+    return false;
+
+  string key = keyOf(job);
+  auto it = items.find(key);
+  if (it == items.end()) {
+    Item &item = items[key] = {job, priority, nextSeq++};
+    save(item);
+    schedule(key, item);
+    return true;
+  }
+
+  Item &item = it->second;
+  if (item.inFlight) {
+    // a chapter being fetched gets the fresh urls anyway, only the manga may
+    // have changed again since its crawl started
+    if (job.kind == CrawlManga) {
+      item.dirty = true;
+      item.priority = max(item.priority, priority);
+    }
+    return false;
+  }
+
+  if (priority <= item.priority)
+    return false;
+
+  // the old entry becomes stale as the seq changes
+  item.priority = priority;
+  item.seq = nextSeq++;
+  save(item);
+  schedule(key, item);
+  return false;
+}
+
+bool CrawlQueue::pop(CrawlJob &job) {
+  lock_guard<std::mutex> guard(mutex);
+
+  // move the due retries to the ready queue
+  long long current = now();
+  while (!delayed.empty() && delayed.top().first <= current) {
+    string key = delayed.top().second;
+    delayed.pop();
+
+    auto it = items.find(key);
+    if (it != items.end() && !it->second.inFlight &&
+        it->second.nextAttempt <= current)
+      ready[it->second.priority].emplace_back(it->second.seq, key);
+  }
+
+  for (auto level = ready.begin(); level != ready.end();) {
+    deque<pair<long long, string>> &entries = level->second;
+
+    while (!entries.empty()) {
+      auto [seq, key] = std::move(entries.front());
+      entries.pop_front();
+
+      auto it = items.find(key);
+      if (it == items.end() || it->second.seq != seq || it->second.inFlight)
+        continue;
+
+      it->second.inFlight = true;
+      job = it->second.job;
+      return true;
+    }
+
+    level = ready.erase(level);
+  }
+
+  return false;
+}
+
+void CrawlQueue::complete(const CrawlJob &job) {
+  lock_guard<std::mutex> guard(mutex);
+
+  string key = keyOf(job);
+  auto it = items.find(key);
+  if (it == items.end())
+    return;
+
+  Item &item = it->second;
+  if (item.dirty) {
+    // it was pushed again while being crawled, crawl it once more
+    item = {item.job, item.priority, nextSeq++};
+    save(item);
+    schedule(key, item);
+    return;
+  }
+
+  enqueueWrite("DELETE FROM CRAWL_QUEUE WHERE KIND = :kind AND ID = :id AND "
+               "EXTRA_DATA = :extra_data",
+               {(long long)job.kind, job.id, job.extraData});
+  items.erase(it);
+}
+
+void CrawlQueue::retry(const CrawlJob &job) {
+  lock_guard<std::mutex> guard(mutex);
+
+  string key = keyOf(job);
+  auto it = items.find(key);
+  if (it == items.end())
+    return;
+
+  Item &item = it->second;
+  long long delay = CRAWL_MAX_RETRY_DELAY;
+  if (item.attempts < 16)
+    delay = min<long long>(delay, CRAWL_RETRY_DELAY << item.attempts);
+
+  item.attempts++;
+  item.nextAttempt = now() + delay;
+  item.inFlight = false;
+  item.dirty = false;
+  item.seq = nextSeq++;
+  save(item);
+  schedule(key, item);
+}
+
+json CrawlQueue::getStats() {
+  lock_guard<std::mutex> guard(mutex);
+
+  long long current = now();
+  int ready = 0, delayed = 0, inFlight = 0, chapters = 0;
+  for (const auto &pair : items) {
+    if (pair.second.inFlight)
+      inFlight++;
+    else if (pair.second.nextAttempt > current)
+      delayed++;
+    else
+      ready++;
+
+    if (pair.second.job.kind == CrawlChapter)
+      chapters++;
+  }
+
+  return {{"ready", ready},
+          {"delayed", delayed},
+          {"inFlight", inFlight},
+          {"chapters", chapters},
+          {"pendingWrites", writes.size()}};
+}
+
+string CrawlQueue::keyOf(const CrawlJob &job) {
+  return fmt::format("{}\u001D{}\u001D{}", (int)job.kind, job.id,
+                     job.extraData);
+}
+
+void CrawlQueue::schedule(const string &key, Item &item) {
+  if (item.nextAttempt > now())
+    delayed.emplace(item.nextAttempt, key);
+  else
+    ready[item.priority].emplace_back(item.seq, key);
+}
+
+void CrawlQueue::save(const Item &item) {
+  enqueueWrite(SAVE_CRAWL_ITEM_SQL,
+               {(long long)item.job.kind, item.job.id, item.job.extraData,
+                (long long)item.priority, item.seq, (long long)item.attempts,
+                item.nextAttempt});
+}
+
+void CrawlQueue::enqueueWrite(const string &sql,
+                              vector<StatementParam> params) {
+  writes.push_back({sql, std::move(params)});
+  writeWake.notify_one();
+}
+
+void CrawlQueue::writeLoop() {
+  while (true) {
+    unique_lock<std::mutex> guard(mutex);
+    writeWake.wait(guard, [this] { return !writes.empty(); });
+
+    vector<Write> batch;
+    batch.swap(writes);
+    guard.unlock();
+
+    // the writes are made in the order of the changes, without the lock
+    for (const auto &write : batch) {
+      try {
+        statements->execute(*pool, write.sql, write.params);
+      } catch (...) {
+        log("CrawlQueue", "Failed to Save the Queue");
+      }
+    }
+  }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../../utils/statementCache.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <queue>
+#include <soci/soci.h>
+#include <string>
+#include <unordered_map>
+
+using json = nlohmann::json;
+using namespace std;
+using namespace soci;
+
+// The priority of the chapters whose urls are stale or rejected.
+#define CRAWL_PRIORITY_REFRESH 2
+// The priority of the manga found by the updates.
+#define CRAWL_PRIORITY_UPDATE 1
+// The priority of the chapters prefetched after their manga is crawled.
+#define CRAWL_PRIORITY_PREFETCH -1
+
+enum CrawlKind {
+  // Fetch the manga and its chapters.
+  CrawlManga,
+  // Fetch the urls of a chapter.
+  CrawlChapter,
+};
+
+struct CrawlJob {
+  CrawlKind kind;
+  string id;
+  // The extra data of the chapter, empty for manga.
+  string extraData;
+};
+
+// This is the queue of the jobs waiting to be crawled.
+// Every item is kept in the CRAWL_QUEUE table until it is completed, so the
+// queue resumes in place after a restart. The order, deduplication, and retry
+// delays are kept in memory.
+// The changes are written to the table by a writer thread in their order, so
+// no session is leased while the lock is held. The last changes may be lost
+// in a crash, the lost jobs are found again by the next polls.
+class CrawlQueue {
+public:
+  // Load the queue from the database, and import the waiting list of the old
+  // json state file if it exists.
+  void open(connection_pool *pool, StatementCache *statements,
+            const string &statePath);
+
+  // Add the job to the queue. If it is already queued, only its priority will
+  // be raised. If a manga is being crawled, it will be queued again afterward,
+  // while a chapter being fetched is not.
+  // The jobs pushed before the queue is opened are dropped.
+  // Return true if the job was not queued yet.
+  // This should not be called while holding a session of the pool, e.g. in
+  // the onRow of a query, so the writer is not starved of sessions.
+  bool push(const CrawlJob &job, int priority = 0);
+
+  // Take the next job that is due. Return false if there is none.
+  // The job must be passed to complete or retry afterward.
+  bool pop(CrawlJob &job);
+
+  // Remove the crawled job from the queue.
+  void complete(const CrawlJob &job);
+
+  // Put the job back into the queue after a delay that grows with the number
+  // of attempts.
+  void retry(const CrawlJob &job);
+
+  json getStats();
+
+private:
+  struct Item {
+    CrawlJob job;
+    int priority;
+    long long seq;
+    int attempts = 0;
+    long long nextAttempt = 0;
+    bool inFlight = false;
+    // Pushed again while being crawled.
+    bool dirty = false;
+  };
+
+  struct Write {
+    string sql;
+    vector<StatementParam> params;
+  };
+
+  std::mutex mutex;
+  connection_pool *pool = nullptr;
+  StatementCache *statements = nullptr;
+  // The items keyed by the kind, id, and extra data of their jobs.
+  unordered_map<string, Item> items;
+  // The ready keys of each priority in FIFO order, the highest priority
+  // first. An entry is stale if its seq does not match the item anymore.
+  map<int, deque<pair<long long, string>>, greater<int>> ready;
+  // The keys waiting for a retry, the earliest first.
+  priority_queue<pair<long long, string>, vector<pair<long long, string>>,
+                 greater<pair<long long, string>>>
+      delayed;
+  long long nextSeq = 0;
+  // The writes waiting for the writer, the oldest first.
+  vector<Write> writes;
+  condition_variable writeWake;
+
+  static string keyOf(const CrawlJob &job);
+
+  // Queue the item, or delay it if it is not due yet.
+  void schedule(const string &key, Item &item);
+
+  void save(const Item &item);
+
+  // Queue the write for the writer. The lock must be held.
+  void enqueueWrite(const string &sql, vector<StatementParam> params);
+
+  // Make the queued writes in order.
+  void writeLoop();
+};
@@ -20,6 +20,10 @@ MHG::MHG() {
   supportSuggestion = false;
   recommendedChunkSize = 5;
   timeout = 10;
+  minUpdateInterval = 120;
+  maxUpdateInterval = 900;
+  // the image urls are signed
+  urlTtl = 43200;
 
   for (const auto &pair : genreText)
     supportedGenres.push_back(pair.first);
@@ -103,7 +107,8 @@ vector<string> MHG::getChapter(string id, string extraData, string proxy) {
   return result;
 };
 
-vector<Manga *> MHG::getList(Genre genre, int page, Status status) {
+vector<Manga *> MHG::getList(Genre genre, int page, Status status,
+                             string proxy) {
   string url = baseUrl + "list/";
   string filter;
 
@@ -124,7 +129,10 @@ vector<Manga *> MHG::getList(Genre genre, int page, Status status) {
   // add page
   url += "index_p" + to_string(page) + ".html";
 
-  cpr::Response r = cpr::Get(cpr::Url{url}, cpr::Timeout{TIMEOUT_LIMIT});
+  cpr::Response r = proxy == ""
+                        ? cpr::Get(cpr::Url{url}, cpr::Timeout{TIMEOUT_LIMIT})
+                        : cpr::Get(cpr::Url{url}, cpr::Timeout{TIMEOUT_LIMIT},
+                                   cpr::Proxies{{"https", proxy}});
 
   CHECK_TIMEOUT()
 
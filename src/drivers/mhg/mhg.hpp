@@ -16,7 +16,8 @@ public:
 
   vector<string> getChapter(string id, string extraData, string proxy) override;
 
-  vector<Manga *> getList(Genre genre, int page, Status status) override;
+  vector<Manga *> getList(Genre genre, int page, Status status,
+                          string proxy) override;
 
   vector<Manga *> search(string keyword, int page) override;
 
@@ -56,13 +56,16 @@ Manga *SelfContained::createManga(DetailsManga *manga) {
   string encodedGenres = fmt::format("{}", fmt::join(genres, "|"));
 
   sql << "INSERT INTO MANGA (ID, THUMBNAIL, TITLE, DESCRIPTION, IS_ENDED, "
-         "AUTHORS, GENRES, LATEST, UPDATE_TIME, EXTRA_DATA) VALUES (:id, "
-         ":thumbnail, :title, :description, :is_ended, :authors, "
-         ":genres, :latest, :update_time, :extras_data)",
+         "AUTHORS, GENRES, GENRE_MASK, LATEST, UPDATE_TIME, EXTRA_DATA) "
+         "VALUES (:id, :thumbnail, :title, :description, :is_ended, "
+         ":authors, :genres, :genre_mask, :latest, :update_time, "
+         ":extras_data)",
       use(manga->id), use(manga->thumbnail), use(manga->title),
       use(manga->description), use((int)manga->isEnded), use(encodedAuthors),
-      use(encodedGenres), use(manga->latest), use(*manga->updateTime),
+      use(encodedGenres), use(genresToMask(manga->genres)),
+      use(manga->latest), use(*manga->updateTime),
       use(manga->chapters.extraData);
+  onMangaChanged(manga->id);
 
   row r;
   sql << "SELECT * FROM MANGA WHERE ID = :id", use(manga->id), into(r);
@@ -87,10 +90,12 @@ Manga *SelfContained::editManga(DetailsManga *manga) {
   string encodedGenres = fmt::format("{}", fmt::join(genres, "|"));
 
   sql << "UPDATE MANGA SET TITLE = :title, DESCRIPTION = :description, "
-         "IS_ENDED = :is_ended, AUTHORS = :authors, GENRES = "
-         ":genres WHERE ID = :id",
+         "IS_ENDED = :is_ended, AUTHORS = :authors, GENRES = :genres, "
+         "GENRE_MASK = :genre_mask WHERE ID = :id",
       use(manga->title), use(manga->description), use((int)manga->isEnded),
-      use(encodedAuthors), use(encodedGenres), use(manga->id);
+      use(encodedAuthors), use(encodedGenres),
+      use(genresToMask(manga->genres)), use(manga->id);
+  onMangaChanged(manga->id);
 
   Manga *newManga = getManga({manga->id}, true).at(0);
 
@@ -103,18 +108,20 @@ Manga *SelfContained::editManga(DetailsManga *manga) {
 void SelfContained::deleteManga(string id) {
   CHECK_ONLINE()
 
-  session sql(*pool);
-
-  // Delete chapters
-  rowset<row> rs =
-      (sql.prepare << "SELECT ID FROM CHAPTER WHERE MANGA_ID = :id", use(id));
-
+  // every step leases its own session, so none is held across them
   vector<string> ids;
-  for (auto it = rs.begin(); it != rs.end(); it++) {
-    const row &row = *it;
-    ids.push_back(row.get<string>("ID"));
+  {
+    session sql(*pool);
+    rowset<row> rs =
+        (sql.prepare << "SELECT ID FROM CHAPTER WHERE MANGA_ID = :id", use(id));
+
+    for (auto it = rs.begin(); it != rs.end(); it++) {
+      const row &row = *it;
+      ids.push_back(row.get<string>("ID"));
+    }
   }
 
+  // Delete chapters
   for (const auto &chapterId : ids)
     deleteChapter(chapterId, id);
 
@@ -125,7 +132,11 @@ void SelfContained::deleteManga(string id) {
   delete manga;
 
   // Delete manga
-  sql << "DELETE FROM MANGA WHERE ID = :id", use(id);
+  {
+    session sql(*pool);
+    sql << "DELETE FROM MANGA WHERE ID = :id", use(id);
+  }
+  onMangaChanged(id);
 }
 
 Chapters SelfContained::createChapter(string extraData, string title,
@@ -154,6 +165,7 @@ string SelfContained::createChapterReturnId(string extraData, string title,
               chrono::system_clock::now().time_since_epoch())
               .count()),
       use(title), use(extraData);
+  onMangaChanged(extraData);
 
   return id;
 }
@@ -200,6 +212,7 @@ Chapters SelfContained::editChapters(Chapters chapters) {
   } catch (...) {
     tr.rollback();
   }
+  onMangaChanged(chapters.extraData);
 
   return getChapters(chapters.extraData);
 }
@@ -207,19 +220,20 @@ Chapters SelfContained::editChapters(Chapters chapters) {
 void SelfContained::deleteChapter(string id, string extraData) {
   CHECK_ONLINE()
 
-  session sql(*pool);
+  // delete the image first, before the session is leased as getChapter
+  // leases its own
+  for (const auto &hash : getChapter(id, extraData))
+    imagesManager.deleteImage(this->id, "manga", hash);
 
-  // delete the image first
-  string urls;
-  indicator ind;
-  sql << "SELECT URLS FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
-      use(extraData), use(id), into(urls, ind);
-  if (ind != i_null)
-    for (const auto &hash : split(urls, R"(\|)"))
-      imagesManager.deleteImage(this->id, "manga", hash);
-
-  sql << "DELETE FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
-      use(extraData), use(id);
+  {
+    session sql(*pool);
+    sql << "DELETE FROM CHAPTER_IMAGE WHERE MANGA_ID = :extra_data AND "
+           "CHAPTER_ID = :id",
+        use(extraData), use(id);
+    sql << "DELETE FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
+        use(extraData), use(id);
+  }
+  onMangaChanged(extraData);
 }
 
 vector<string> SelfContained::uploadThumbnail(string id, const string &image) {
@@ -239,6 +253,7 @@ vector<string> SelfContained::uploadThumbnail(string id, const string &image) {
   // insert the new thumbnail
   sql << "UPDATE MANGA SET THUMBNAIL = :thumbnail WHERE ID = :id",
       use(thumbnail), use(id);
+  onMangaChanged(id);
 
   return imagesManager.getImage(this->id, "thumbnail", thumbnail, false);
 }
@@ -251,25 +266,9 @@ vector<string> SelfContained::uploadMangaImage(string id, string extraData,
 
   session sql(*pool);
 
-  // get the previous urls
-  string urls;
-  indicator ind;
-  sql << "SELECT URLS FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
-      use(extraData), use(id), into(urls, ind);
-
-  if (ind != i_null)
-    urls += "|";
-  urls += manga;
-
-  statement st = (sql.prepare << "UPDATE CHAPTER SET URLS = :urls WHERE "
-                                 "MANGA_ID = :extra_data AND "
-                                 "ID = :id",
-                  use(urls), use(extraData), use(id));
-  st.execute(true);
-
   // if the database is not updated, that means something went wrong and the
   // image should be deleted.
-  if (!st.get_affected_rows())
+  if (!appendChapterImages(sql, id, extraData, {manga}))
     imagesManager.deleteImage(this->id, "manga", manga);
 
   return imagesManager.getImage(this->id, "manga", manga, false);
@@ -283,30 +282,17 @@ vector<string> SelfContained::uploadMangaImages(string id, string extraData,
   for (const auto &image : images)
     newUrls.push_back(imagesManager.saveImage(this->id, "manga", image));
 
-  session sql(*pool);
-
-  // get the previous urls
-  string urls;
-  indicator ind;
-  sql << "SELECT URLS FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
-      use(extraData), use(id), into(urls, ind);
-
-  if (ind != i_null && !urls.empty())
-    urls += "|";
-  urls += fmt::format("{}", fmt::join(newUrls, "|"));
-
-  statement st = (sql.prepare << "UPDATE CHAPTER SET URLS = :urls WHERE "
-                                 "MANGA_ID = :extra_data AND "
-                                 "ID = :id",
-                  use(urls), use(extraData), use(id));
-  st.execute(true);
+  {
+    session sql(*pool);
 
-  // if the database is not updated, that means something went wrong and the
-  // image should be deleted.
-  if (!st.get_affected_rows())
-    for (const auto &url : newUrls)
-      imagesManager.deleteImage(this->id, "manga", url);
+    // if the database is not updated, that means something went wrong and the
+    // image should be deleted.
+    if (!appendChapterImages(sql, id, extraData, newUrls))
+      for (const auto &url : newUrls)
+        imagesManager.deleteImage(this->id, "manga", url);
+  }
 
+  // getChapter leases its own session
   return getChapter(id, extraData);
 }
 
@@ -314,8 +300,6 @@ vector<string> SelfContained::arrangeMangaImage(string id, string extraData,
                                                 vector<string> newUrls) {
   CHECK_ONLINE()
 
-  session sql(*pool);
-
   vector<string> newHashes;
   string hash;
 
@@ -324,10 +308,8 @@ vector<string> SelfContained::arrangeMangaImage(string id, string extraData,
       newHashes.push_back(hash);
   }
 
-  string urls;
-  sql << "SELECT URLS FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
-      use(extraData), use(id), into(urls);
-  vector<string> oldHashes = split(urls, R"(\|)");
+  // getChapter leases its own session, so it is called without holding one
+  vector<string> oldHashes = getChapter(id, extraData);
 
   try {
     for (const auto &hash : newHashes) {
@@ -341,10 +323,13 @@ vector<string> SelfContained::arrangeMangaImage(string id, string extraData,
     if (!oldHashes.empty())
       throw "Missing hash";
 
-    sql << fmt::format("UPDATE CHAPTER SET URLS = \"{}\" WHERE MANGA_ID = "
-                       ":extra_data AND ID = :id",
-                       fmt::join(newHashes, "|")),
+    session sql(*pool);
+    transaction tr(sql);
+    sql << "DELETE FROM CHAPTER_IMAGE WHERE MANGA_ID = :extra_data AND "
+           "CHAPTER_ID = :id",
         use(extraData), use(id);
+    appendChapterImages(sql, id, extraData, newHashes);
+    tr.commit();
   } catch (...) {
   }
 
@@ -360,20 +345,9 @@ void SelfContained::deleteMangaImage(string id, string extraData, string url) {
   imagesManager.deleteImage(this->id, "manga", hash);
 
   session sql(*pool);
-
-  // get the urls
-  string urls;
-  sql << "SELECT URLS FROM CHAPTER WHERE MANGA_ID = :extra_data AND ID = :id",
-      use(extraData), use(id), into(urls);
-
-  // remove the hash from the urls
-  RE2::GlobalReplace(&urls, R"(\|?)" + hash, "");
-  if (!urls.empty() && urls.rfind("|", 0) == 0)
-    urls.erase(urls.begin());
-
-  sql << "UPDATE CHAPTER SET URLS = :urls WHERE MANGA_ID = :extra_data AND ID "
-         "= :id",
-      use(urls), use(extraData), use(id);
+  sql << "DELETE FROM CHAPTER_IMAGE WHERE MANGA_ID = :extra_data AND "
+         "CHAPTER_ID = :id AND REF = :ref",
+      use(extraData), use(id), use(hash);
 }
 
 string SelfContained::useProxy(const string &dest, const string &genre,
@@ -488,19 +462,26 @@ vector<string> SelfContained::downloadManga(string id, bool asCBZ) {
                    info.size());
     }
 
-    session sql(*pool);
-    indicator ind;
-    rowset<row> rs =
-        (sql.prepare << "SELECT * FROM CHAPTER WHERE MANGA_ID = :manga_id",
-         use(id));
+    // read the chapters first, getChapter leases its own session
+    vector<tuple<string, bool, string>> chapters;
+    {
+      session sql(*pool);
+      rowset<row> rs =
+          (sql.prepare << "SELECT * FROM CHAPTER WHERE MANGA_ID = :manga_id",
+           use(id));
+
+      for (auto it = rs.begin(); it != rs.end(); it++) {
+        const row &row = *it;
+        chapters.emplace_back(row.get<string>("ID"),
+                              row.get<int>("IS_EXTRA") == 1,
+                              row.get<string>("TITLE"));
+      }
+    }
+
     vector<vector<string>> imgs;
     vector<string> cbz;
 
-    for (auto it = rs.begin(); it != rs.end(); it++) {
-      const row &row = *it;
-
-      bool isExtra = row.get<int>("IS_EXTRA") == 1;
-      string ctitle = row.get<string>("TITLE");
+    for (auto [chapterId, isExtra, ctitle] : chapters) {
       RE2::GlobalReplace(&ctitle, R"(\/)", " ");
       string path =
           asCBZ ? fmt::format("{}/{}/", title, isExtra ? "Extra" : "Serial")
@@ -508,12 +489,7 @@ vector<string> SelfContained::downloadManga(string id, bool asCBZ) {
                               ctitle);
       zip->addEntry(path);
 
-      vector<string> urls;
-
-      // get the urls
-      ind = row.get_indicator("URLS");
-      if (ind != i_null)
-        urls = split(row.get<string>("URLS"), R"(\|)");
+      vector<string> urls = getChapter(chapterId, id);
 
       // create secondary zip for CBZ
       void *secBuffer = calloc(4096, sizeof(char));
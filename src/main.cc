@@ -114,9 +114,25 @@ int main() {
       if (image.contains("proxy"))
         imagesManager.setProxy(image["proxy"].get<string>());
 
-      // set interval
+      // set the number of threads fetching the images
+      if (image.contains("fetchThreads"))
+        imagesManager.setFetchThreads(image["fetchThreads"].get<int>());
+
+      // set the size limit of the cache
+      unsigned long long cacheSize =
+          image.value("cacheSize", DEFAULT_IMAGE_CACHE_SIZE);
+      if (image.contains("cacheSize") || image.contains("quotas"))
+        imagesManager.setCacheSize(
+            cacheSize,
+            image.value("quotas", map<string, unsigned long long>()));
+
+      // the periodic wipe is replaced by the size limit
       if (image.contains("clearCaches"))
-        imagesManager.setInterval(image["clearCaches"].get<string>());
+        log("RaitoServer",
+            fmt::format("image.clearCaches is no longer supported, the cached "
+                        "images are limited by image.cacheSize to {} bytes",
+                        cacheSize),
+            fmt::color::light_golden_rod_yellow);
     }
 
     if (config.contains("accessGuard"))
@@ -149,6 +165,8 @@ int main() {
       driversManager.add(driver);
   }
 
+  imagesManager.open();
+
   // All libraries are initialized
   driversManager.isReady = true;
 
@@ -22,6 +22,9 @@ void AccessGuard::applyConfig(json config) {
   if (config.contains("parameters"))
     parameters = new string(config["parameters"].get<string>());
 
+  if (config.contains("sqlite"))
+    sqliteProfile = SqliteProfile::fromJson(config["sqlite"]);
+
   json admin;
   if (config.contains("admin"))
     admin = config["admin"];
@@ -123,11 +126,17 @@ void AccessGuard::initializeDatabase() {
     for (size_t i = 0; i != poolSize; ++i) {
       session &sql = pool->at(i);
       sql.open(*sqlName, *parameters);
+
+      if (*sqlName == "sqlite3")
+        sqliteProfile.apply(sql);
     }
 
     session sql(*pool);
     sql << CREATE_TOKEN_TABLES_SQL;
 
+    if (*sqlName == "sqlite3")
+      sqliteProfile.startMaintenance(pool, "AccessGuard");
+
   } catch (string e) {
     log("AccessGuard", "Failed to Connect to the Database");
   }
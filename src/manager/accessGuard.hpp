@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../utils/sqliteProfile.hpp"
+
 #include <map>
 #include <nlohmann/json.hpp>
 #include <soci/soci.h>
@@ -35,6 +37,7 @@ private:
   // For "token" mode only
   string *sqlName;
   string *parameters;
+  SqliteProfile sqliteProfile;
   // For "admin"
   string *adminKey;
   bool allowOnlyLocal = true;
@@ -0,0 +1,476 @@
+#include "imageStore.hpp"
+#include "../utils/log.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fmt/format.h>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// The extension of the cached images.
+#define IMAGE_STORE_FORMAT "webp"
+
+static long long now() {
+  return chrono::duration_cast<chrono::seconds>(
+             chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Split the line of the log by tabs.
+static vector<string> fieldsOf(const string &line) {
+  vector<string> fields;
+  size_t start = 0, end;
+  while ((end = line.find('\t', start)) != string::npos) {
+    fields.push_back(line.substr(start, end - start));
+    start = end + 1;
+  }
+  fields.push_back(line.substr(start));
+
+  return fields;
+}
+
+ImageStore::ImageStore() : cache([this](const string &key) { evict(key); }) {}
+
+void ImageStore::open(const string &root, const string &excluded) {
+  this->root = root;
+  filesystem::create_directories(root);
+
+  logPath = root + "/index.log";
+  if (filesystem::exists(logPath)) {
+    ifstream logIn(logPath);
+    string line;
+    while (getline(logIn, line))
+      replay(line);
+    logIn.close();
+
+    removeOrphans(excluded);
+  } else {
+    import(excluded);
+  }
+
+  tryCompact();
+  logFile.open(logPath, ios::app);
+
+  // index the cached images, the least recently used first
+  vector<tuple<long long, string, unsigned long long>> cached;
+  for (auto &shard : shards)
+    for (const auto &pair : shard.records)
+      if (pair.second.size > 0)
+        cached.emplace_back(pair.second.accessTime, pair.first,
+                            pair.second.size);
+
+  sort(cached.begin(), cached.end());
+  for (const auto &[time, key, size] : cached)
+    cache.add(key, key.substr(0, key.find('/')), size);
+
+  cache.start();
+  thread(&ImageStore::flushLoop, this).detach();
+
+  log("ImageStore", fmt::format("Loaded {} Cached Images", cached.size()));
+}
+
+void ImageStore::setCapacity(unsigned long long bytes) {
+  cache.setCapacity(bytes);
+}
+
+void ImageStore::setQuota(const string &id, unsigned long long bytes) {
+  cache.setQuota(id, bytes);
+}
+
+void ImageStore::setSource(const string &id, const string &genre,
+                           const string &hash, const string &source) {
+  string key = keyOf(id, genre, hash);
+  long long current = now();
+
+  Shard &shard = shardOf(hash);
+  unique_lock<std::mutex> guard(shard.mutex);
+  ImageRecord &record = shard.records[key];
+  bool due = markUsed(record, current);
+  if (record.source == source) {
+    guard.unlock();
+
+    if (due)
+      append(fmt::format("A\t{}\t{}", key, current));
+    return;
+  }
+
+  record.source = source;
+  record.loggedAccessTime = current;
+  guard.unlock();
+
+  // the log is line based
+  if (source.find_first_of("\t\n") == string::npos)
+    append(fmt::format("S\t{}\t{}\t{}", key, source, current));
+}
+
+optional<ImageRecord> ImageStore::get(const string &id, const string &genre,
+                                      const string &hash) {
+  string key = keyOf(id, genre, hash);
+  long long current = now();
+
+  Shard &shard = shardOf(hash);
+  unique_lock<std::mutex> guard(shard.mutex);
+  auto it = shard.records.find(key);
+  if (it == shard.records.end())
+    return nullopt;
+
+  bool due = markUsed(it->second, current);
+  ImageRecord record = it->second;
+  guard.unlock();
+
+  if (record.size > 0)
+    cache.touch(key);
+  if (due)
+    append(fmt::format("A\t{}\t{}", key, current));
+
+  return record;
+}
+
+void ImageStore::setCached(const string &id, const string &genre,
+                           const string &hash, unsigned long long size) {
+  string key = keyOf(id, genre, hash);
+  long long current = now();
+
+  Shard &shard = shardOf(hash);
+  unique_lock<std::mutex> guard(shard.mutex);
+  ImageRecord &record = shard.records[key];
+  record.size = size;
+  record.cachedTime = current;
+  record.accessTime = current;
+  record.loggedAccessTime = current;
+  guard.unlock();
+
+  cache.add(key, id, size);
+  append(fmt::format("C\t{}\t{}\t{}\t{}", key, size, current, current));
+}
+
+void ImageStore::dropCached(const string &id, const string &genre,
+                            const string &hash) {
+  string key = keyOf(id, genre, hash);
+
+  Shard &shard = shardOf(hash);
+  unique_lock<std::mutex> guard(shard.mutex);
+  auto it = shard.records.find(key);
+  if (it == shard.records.end() || it->second.size == 0)
+    return;
+
+  it->second.size = 0;
+  guard.unlock();
+
+  cache.erase(key);
+  append(fmt::format("E\t{}", key));
+}
+
+string ImageStore::pathOf(const string &id, const string &genre,
+                          const string &hash) {
+  return fmt::format("{}/{}/{}/{}/{}.{}", root, id, genre, hash.substr(0, 2),
+                     hash, IMAGE_STORE_FORMAT);
+}
+
+json ImageStore::getStats() {
+  size_t records = 0, cached = 0;
+  for (auto &shard : shards) {
+    lock_guard<std::mutex> guard(shard.mutex);
+    records += shard.records.size();
+    for (const auto &pair : shard.records)
+      if (pair.second.size > 0)
+        cached++;
+  }
+
+  return {{"records", records},
+          {"cached", cached},
+          {"cache", cache.getStats()}};
+}
+
+string ImageStore::keyOf(const string &id, const string &genre,
+                         const string &hash) {
+  return fmt::format("{}/{}/{}", id, genre, hash);
+}
+
+ImageStore::Shard &ImageStore::shardOf(const string &hash) {
+  if (hash.empty() || !isxdigit(hash[0]))
+    return shards[0];
+
+  return shards[stoi(hash.substr(0, 1), nullptr, 16) % IMAGE_STORE_SHARDS];
+}
+
+void ImageStore::replay(const string &line) {
+  vector<string> fields = fieldsOf(line);
+  if (fields.size() < 2)
+    return;
+
+  const string &key = fields[1];
+  Shard &shard = shardOf(key.substr(key.rfind('/') + 1));
+
+  try {
+    if (fields[0] == "S" && fields.size() == 4) {
+      ImageRecord &record = shard.records[key];
+      record.source = fields[2];
+      record.accessTime = stoll(fields[3]);
+    } else if (fields[0] == "C" && fields.size() == 5) {
+      ImageRecord &record = shard.records[key];
+      record.size = stoull(fields[2]);
+      record.cachedTime = stoll(fields[3]);
+      record.accessTime = stoll(fields[4]);
+    } else if (fields[0] == "A" && fields.size() == 3) {
+      auto it = shard.records.find(key);
+      if (it != shard.records.end())
+        it->second.accessTime = max(it->second.accessTime, stoll(fields[2]));
+    } else if (fields[0] == "E") {
+      auto it = shard.records.find(key);
+      if (it != shard.records.end())
+        it->second.size = 0;
+    }
+  } catch (...) {
+    // the last line may be cut off by a crash
+  }
+}
+
+bool ImageStore::markUsed(ImageRecord &record, long long current) {
+  record.accessTime = current;
+  if (current - record.loggedAccessTime < IMAGE_STORE_ACCESS_INTERVAL)
+    return false;
+
+  record.loggedAccessTime = current;
+  return true;
+}
+
+void ImageStore::compact() {
+  string tempPath = logPath + ".tmp";
+  long long current = now();
+  size_t lines = 0, dropped = 0;
+
+  ofstream out(tempPath, ios::trunc);
+  for (auto &shard : shards) {
+    // hold the lock only while the lines of the shard are formatted
+    string batch;
+    unique_lock<std::mutex> guard(shard.mutex);
+    for (auto it = shard.records.begin(); it != shard.records.end();) {
+      const string &key = it->first;
+      ImageRecord &record = it->second;
+
+      if (record.size == 0 &&
+          current - record.accessTime >= IMAGE_STORE_RECORD_TTL) {
+        it = shard.records.erase(it);
+        dropped++;
+        continue;
+      }
+
+      if (record.source.find_first_of("\t\n") == string::npos) {
+        batch += fmt::format("S\t{}\t{}\t{}\n", key, record.source,
+                             record.accessTime);
+        lines++;
+      }
+
+      if (record.size > 0) {
+        batch += fmt::format("C\t{}\t{}\t{}\t{}\n", key, record.size,
+                             record.cachedTime, record.accessTime);
+        lines++;
+      }
+
+      record.loggedAccessTime = record.accessTime;
+      it++;
+    }
+    guard.unlock();
+
+    out.write(batch.data(), batch.size());
+  }
+  out.close();
+
+  // keep the old log if the new one is incomplete
+  if (out.fail())
+    throw "Failed to write the index";
+
+  filesystem::rename(tempPath, logPath);
+  compactedLines = lines;
+
+  if (dropped > 0)
+    log("ImageStore", fmt::format("Dropped {} Unused Records", dropped));
+}
+
+void ImageStore::tryCompact() {
+  try {
+    compact();
+  } catch (...) {
+    log("ImageStore", "Failed to Compact the Index");
+  }
+
+  // a failed compaction is retried on the next interval
+  compactedTime = now();
+  writtenLines = 0;
+}
+
+void ImageStore::removeOrphans(const string &excluded) {
+  // the layout is {root}/{id}/{genre}/{hh}/{hash}.webp
+  vector<filesystem::path> orphans;
+  for (const auto &driver : filesystem::directory_iterator(root)) {
+    if (!driver.is_directory() || driver.path().filename() == excluded)
+      continue;
+
+    for (const auto &genre : filesystem::directory_iterator(driver.path())) {
+      if (!genre.is_directory())
+        continue;
+
+      for (const auto &prefix : filesystem::directory_iterator(genre.path())) {
+        if (!prefix.is_directory())
+          continue;
+
+        for (const auto &entry :
+             filesystem::directory_iterator(prefix.path())) {
+          if (!entry.is_regular_file() ||
+              entry.path().extension() != "." IMAGE_STORE_FORMAT)
+            continue;
+
+          string hash = entry.path().stem().string();
+          string key = keyOf(driver.path().filename().string(),
+                             genre.path().filename().string(), hash);
+
+          Shard &shard = shardOf(hash);
+          auto it = shard.records.find(key);
+          if (it == shard.records.end() || it->second.size == 0)
+            orphans.push_back(entry.path());
+        }
+      }
+    }
+  }
+
+  // the file may be cut off by the crash, it is fetched again when needed
+  for (const auto &path : orphans) {
+    error_code ec;
+    filesystem::remove(path, ec);
+  }
+
+  if (!orphans.empty())
+    log("ImageStore",
+        fmt::format("Removed {} Orphaned Images", orphans.size()));
+}
+
+void ImageStore::import(const string &excluded) {
+  // the old layout is {root}/{id}/{genre}/{hash}.src with the url of the
+  // image, and {hash}.webp next to it if it is cached
+  vector<filesystem::path> sources, images;
+  for (const auto &driver : filesystem::directory_iterator(root)) {
+    if (!driver.is_directory() || driver.path().filename() == excluded)
+      continue;
+
+    for (const auto &genre : filesystem::directory_iterator(driver.path())) {
+      if (!genre.is_directory())
+        continue;
+
+      for (const auto &entry : filesystem::directory_iterator(genre.path())) {
+        if (!entry.is_regular_file())
+          continue;
+
+        if (entry.path().extension() == ".src")
+          sources.push_back(entry.path());
+        else
+          images.push_back(entry.path());
+      }
+    }
+  }
+
+  for (const auto &path : sources) {
+    string hash = path.stem().string();
+    string genre = path.parent_path().filename().string();
+    string id = path.parent_path().parent_path().filename().string();
+    string key = keyOf(id, genre, hash);
+
+    ifstream sourceFile(path);
+    string source;
+    getline(sourceFile, source);
+    sourceFile.close();
+
+    ImageRecord &record = shardOf(hash).records[key];
+    record.source = source;
+    record.accessTime = now();
+
+    error_code ec;
+    filesystem::path image = path;
+    image.replace_extension(IMAGE_STORE_FORMAT);
+    if (filesystem::exists(image, ec)) {
+      string target = pathOf(id, genre, hash);
+      filesystem::create_directories(filesystem::path(target).parent_path());
+      filesystem::rename(image, target, ec);
+
+      if (!ec) {
+        record.size = filesystem::file_size(target, ec);
+        record.cachedTime = record.accessTime;
+      }
+    }
+
+    filesystem::remove(path, ec);
+  }
+
+  // the cached images without a url can't be served
+  for (const auto &path : images) {
+    error_code ec;
+    filesystem::remove(path, ec);
+  }
+
+  if (!sources.empty())
+    log("ImageStore", fmt::format("Imported {} Images", sources.size()));
+}
+
+void ImageStore::append(string line) {
+  lock_guard<std::mutex> guard(logMutex);
+  pending.push_back(std::move(line));
+
+  if (pending.size() >= IMAGE_STORE_FLUSH_BATCH)
+    logWake.notify_one();
+}
+
+void ImageStore::flushLoop() {
+  while (true) {
+    unique_lock<std::mutex> guard(logMutex);
+    logWake.wait_for(guard, chrono::milliseconds(IMAGE_STORE_FLUSH_INTERVAL),
+                     [this] {
+                       return pending.size() >= IMAGE_STORE_FLUSH_BATCH;
+                     });
+
+    vector<string> lines;
+    lines.swap(pending);
+    guard.unlock();
+
+    if (!lines.empty()) {
+      // a single write for the whole batch
+      string batch;
+      for (const auto &line : lines) {
+        batch += line;
+        batch += '\n';
+      }
+
+      logFile.write(batch.data(), batch.size());
+      logFile.flush();
+      writtenLines += lines.size();
+    }
+
+    // the changes made during the compaction stay pending, and are written
+    // to the new log afterward
+    size_t maxLines = max<size_t>(compactedLines, IMAGE_STORE_COMPACT_LINES);
+    if (now() - compactedTime >= IMAGE_STORE_COMPACT_INTERVAL ||
+        writtenLines >= maxLines) {
+      logFile.close();
+      tryCompact();
+      logFile.open(logPath, ios::app);
+    }
+  }
+}
+
+void ImageStore::evict(const string &key) {
+  size_t slash = key.rfind('/');
+  string hash = key.substr(slash + 1);
+
+  Shard &shard = shardOf(hash);
+  unique_lock<std::mutex> guard(shard.mutex);
+  auto it = shard.records.find(key);
+  if (it != shard.records.end())
+    it->second.size = 0;
+  guard.unlock();
+
+  error_code ec;
+  filesystem::remove(fmt::format("{}/{}/{}/{}.{}", root, key.substr(0, slash),
+                                 hash.substr(0, 2), hash, IMAGE_STORE_FORMAT),
+                     ec);
+  append(fmt::format("E\t{}", key));
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../utils/imageCache.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+using json = nlohmann::json;
+using namespace std;
+
+// The number of shards of the index. The images are sharded by the first hex
+// digit of their hashes.
+#define IMAGE_STORE_SHARDS 16
+// The longest time the changes wait before they are written to the log in
+// milliseconds.
+#define IMAGE_STORE_FLUSH_INTERVAL 1000
+// The number of pending changes that wakes the writer early.
+#define IMAGE_STORE_FLUSH_BATCH 1024
+// How long a record without a cached image is kept after its last use in
+// seconds.
+#define IMAGE_STORE_RECORD_TTL (7 * 24 * 3600)
+// The shortest time between the writes of the access time of a record to the
+// log in seconds.
+#define IMAGE_STORE_ACCESS_INTERVAL 3600
+// The longest time between the compactions of the log in seconds.
+#define IMAGE_STORE_COMPACT_INTERVAL (24 * 3600)
+// The log is compacted early once the lines written since the last
+// compaction reach this number and the number of lines it was left with.
+#define IMAGE_STORE_COMPACT_LINES 1000000
+
+struct ImageRecord {
+  // The url of the upstream image.
+  string source;
+  // The size of the cached image in bytes, 0 if it is not cached.
+  unsigned long long size = 0;
+  // When the image was cached and last used in seconds since the epoch.
+  long long cachedTime = 0;
+  long long accessTime = 0;
+  // The access time last written to the log.
+  long long loggedAccessTime = 0;
+};
+
+// This class stores the proxied images by their hashes.
+// The index of the images is kept in memory and persisted to an append-only
+// log, so resolving an image needs no filesystem calls. The changes are
+// written to the log in batches by a background thread, the ones made in the
+// last second may be lost in a crash. The images cached in that second are
+// removed when the store is opened again.
+// The cached images are sharded into directories by the first two hex digits
+// of their hashes, and the least recently used ones are evicted once the cache
+// is full. The log is compacted periodically, dropping the records without a
+// cached image that have not been used for a while.
+class ImageStore {
+public:
+  ImageStore();
+
+  // Load the index from the log, remove the orphaned images, compact the log,
+  // and start the eviction.
+  // The images of the old flat layout are imported on the first run, except
+  // the images of the excluded driver.
+  void open(const string &root, const string &excluded);
+
+  // Set the size limit of the cached images in bytes, 0 means no limit.
+  void setCapacity(unsigned long long bytes);
+
+  // Set the size limit of the cached images of the driver in bytes.
+  void setQuota(const string &id, unsigned long long bytes);
+
+  // Record the url of the upstream image.
+  void setSource(const string &id, const string &genre, const string &hash,
+                 const string &source);
+
+  // Return the record of the image and mark it as used.
+  // The access times are written to the log at most once an hour, so the
+  // order of the cached images survives a restart roughly.
+  optional<ImageRecord> get(const string &id, const string &genre,
+                            const string &hash);
+
+  // Record the cached image of the given size.
+  void setCached(const string &id, const string &genre, const string &hash,
+                 unsigned long long size);
+
+  // Forget the cached image, e.g. after its file is found missing.
+  void dropCached(const string &id, const string &genre, const string &hash);
+
+  // Return the path of the cached image.
+  string pathOf(const string &id, const string &genre, const string &hash);
+
+  json getStats();
+
+private:
+  struct Shard {
+    std::mutex mutex;
+    // The records keyed by {id}/{genre}/{hash}.
+    unordered_map<string, ImageRecord> records;
+  };
+
+  string root;
+  string logPath;
+  array<Shard, IMAGE_STORE_SHARDS> shards;
+  std::mutex logMutex;
+  condition_variable logWake;
+  ofstream logFile;
+  // The lines waiting to be written to the log.
+  vector<string> pending;
+  // Only used by the writer after the store is opened.
+  long long compactedTime = 0;
+  size_t compactedLines = 0;
+  size_t writtenLines = 0;
+  ImageCache cache;
+
+  static string keyOf(const string &id, const string &genre,
+                      const string &hash);
+
+  Shard &shardOf(const string &hash);
+
+  // Apply a line of the log to the index.
+  void replay(const string &line);
+
+  // Mark the record as used. Return true if its access time is due to be
+  // written to the log.
+  static bool markUsed(ImageRecord &record, long long current);
+
+  // Rewrite the log with only the current records, dropping the records
+  // without a cached image that have not been used for
+  // IMAGE_STORE_RECORD_TTL.
+  void compact();
+
+  // Compact the log, and log the failure instead of throwing it.
+  void tryCompact();
+
+  // Remove the cached images without a record in the index, e.g. the ones
+  // whose records were lost in a crash, except the images of the excluded
+  // driver.
+  void removeOrphans(const string &excluded);
+
+  // Move the images of the old flat layout into the store.
+  void import(const string &excluded);
+
+  // Queue the line to be written to the log.
+  void append(string line);
+
+  // Write the pending lines to the log in batches.
+  void flushLoop();
+
+  // Remove the evicted image.
+  void evict(const string &key);
+};
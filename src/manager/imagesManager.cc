@@ -11,6 +11,11 @@
 #define SAVE_FORMAT "webp"
 #define FIF_FORMAT FIF_WEBP
 
+// The default number of threads fetching the images.
+#define DEFAULT_FETCH_THREADS 16
+
+ImagesManager::ImagesManager() { store.setCapacity(DEFAULT_IMAGE_CACHE_SIZE); }
+
 void ImagesManager::add(string id, cpr::Header headers) {
   settings[id] = headers;
 }
@@ -19,23 +24,34 @@ void ImagesManager::setBaseUrl(string url) { this->url = url; }
 
 void ImagesManager::setProxy(string proxy) { this->proxy = new string(proxy); }
 
+void ImagesManager::setFetchThreads(int threads) {
+  if (fetchPool != nullptr)
+    return;
+
+  fetchPool = new ThreadPool(threads);
+}
+
+void ImagesManager::open() {
+  setFetchThreads(DEFAULT_FETCH_THREADS);
+
+  try {
+    store.open("../image",
+               driversManager.cmsId != nullptr ? *driversManager.cmsId : "");
+  } catch (...) {
+    log("ImagesManager", "Failed to Open the Image Store");
+  }
+}
+
 string ImagesManager::getPath(const string &id, const string &genre,
                               const string &dest, const string &baseUrl) {
-  filesystem::create_directories(fmt::format("../image/{}/{}", id, genre));
+  // compiled once, this is called for every proxied url
+  static const RE2 host(R"(https?:\/\/([^\/]+))");
 
   string removeHost = dest;
-  RE2::GlobalReplace(&removeHost, R"(https?:\/\/([^\/]+))", "");
+  RE2::GlobalReplace(&removeHost, host, "");
 
   string hash = MD5()(removeHost);
-
-  string path = fmt::format("../image/{}/{}/{}.src", id, genre, hash);
-  string cachePath =
-      fmt::format("../image/{}/{}/{}.{}", id, genre, hash, SAVE_FORMAT);
-  if (!filesystem::exists(cachePath)) {
-    std::ofstream ofs(path, ios::trunc);
-    ofs << dest;
-    ofs.close();
-  }
+  store.setSource(id, genre, hash, dest);
 
   return fmt::format("{}image/{}/{}/{}.{}", url.empty() ? baseUrl : url, id,
                      genre, hash, SAVE_FORMAT);
@@ -43,50 +59,104 @@ string ImagesManager::getPath(const string &id, const string &genre,
 
 string ImagesManager::getLocalPath(const string &id, const string &genre,
                                    const string &dest, const string &baseUrl) {
-  filesystem::create_directories(fmt::format("../image/{}/{}", id, genre));
-
   return fmt::format("{}image/{}/{}/{}.{}", url.empty() ? baseUrl : url, id,
                      genre, dest, SAVE_FORMAT);
 }
 
+// Return the image data in the requested encoding.
+static vector<string> encodeImage(const string &imageData, bool asBase64) {
+  if (asBase64)
+    return {"txt", fmt::format("data:{};base64, {}", mime_types.at(SAVE_FORMAT),
+                               base64::to_base64(imageData))};
+
+  return {SAVE_FORMAT, imageData};
+}
+
+// Read the whole file, return false if it can't be opened.
+static bool readFile(const string &path, string &data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  std::ostringstream oss;
+  oss << file.rdbuf();
+  data = oss.str();
+
+  return true;
+}
+
+// Remove the extension of the cached image from the hash.
+static string withoutExtension(const string &hash) {
+  static const RE2 extension(fmt::format(R"(\.{})", SAVE_FORMAT));
+
+  string result = hash;
+  RE2::GlobalReplace(&result, extension, "");
+
+  return result;
+}
+
+bool ImagesManager::getCachedImage(const string &id, const string &genre,
+                                   const string &hash, string &path,
+                                   long long &modifiedTime) {
+  string hashWithoutExtension = withoutExtension(hash);
+
+  // the images of the CMS are stored as they are
+  if (driversManager.cmsId != nullptr && id == *driversManager.cmsId) {
+    path =
+        fmt::format("../image/{}/{}/{}.src", id, genre, hashWithoutExtension);
+
+    error_code ec;
+    filesystem::file_time_type time = filesystem::last_write_time(path, ec);
+    if (ec)
+      return false;
+
+    modifiedTime = chrono::duration_cast<chrono::seconds>(
+                       chrono::file_clock::to_sys(time).time_since_epoch())
+                       .count();
+    return true;
+  }
+
+  optional<ImageRecord> record = store.get(id, genre, hashWithoutExtension);
+  if (!record.has_value() || record->size == 0)
+    return false;
+
+  path = store.pathOf(id, genre, hashWithoutExtension);
+  modifiedTime = record->cachedTime;
+
+  return true;
+}
+
 vector<string> ImagesManager::getImage(const string &id, const string &genre,
                                        const string &hash, bool asBase64) {
+  string hashWithoutExtension = withoutExtension(hash);
 
-  string hashWithoutExtension = string(hash);
-  RE2::GlobalReplace(&hashWithoutExtension, fmt::format(".{}", SAVE_FORMAT),
-                     "");
+  string imageData;
 
-  string path =
-      fmt::format("../image/{}/{}/{}.src", id, genre, hashWithoutExtension);
-  if (!filesystem::exists(path))
+  // the images of the CMS are stored as they are
+  if (driversManager.cmsId != nullptr && id == *driversManager.cmsId) {
+    if (!readFile(fmt::format("../image/{}/{}/{}.src", id, genre,
+                              hashWithoutExtension),
+                  imageData))
+      throw "Image cannot be found";
+
+    return encodeImage(imageData, asBase64);
+  }
+
+  optional<ImageRecord> record = store.get(id, genre, hashWithoutExtension);
+  if (!record.has_value())
     throw "Image cannot be found";
 
   // check the cache
-  string imagePath =
-      driversManager.cmsId != nullptr && id == *driversManager.cmsId
-          ? path
-          : fmt::format("../image/{}/{}/{}.{}", id, genre, hashWithoutExtension,
-                        SAVE_FORMAT);
-  if (filesystem::exists(imagePath)) {
-    std::ifstream imageFile(imagePath, std::ios::binary);
-
-    std::ostringstream oss;
-    oss << imageFile.rdbuf();
-    imageFile.close();
-    string imageData = oss.str();
-
-    if (asBase64)
-      return {"txt",
-              fmt::format("data:{};base64, {}", mime_types.at(SAVE_FORMAT),
-                          base64::to_base64(imageData))};
-
-    return {SAVE_FORMAT, imageData};
-  }
+  string imagePath = store.pathOf(id, genre, hashWithoutExtension);
+  if (record->size > 0) {
+    if (readFile(imagePath, imageData))
+      return encodeImage(imageData, asBase64);
 
-  std::ifstream ifs(path);
-  string url;
-  getline(ifs, url);
+    // removed behind the index
+    store.dropCached(id, genre, hashWithoutExtension);
+  }
 
+  string url = record->source;
   RE2::GlobalReplace(&url, " ", "%20");
 
   // fetch the image
@@ -103,6 +173,13 @@ vector<string> ImagesManager::getImage(const string &id, const string &genre,
 
   cpr::Response r = session.Get();
 
+  // let the driver refresh the expired url
+  if (r.status_code == 403 || r.status_code == 404) {
+    BaseDriver *driver = driversManager.get(id);
+    if (driver != nullptr)
+      driver->onImageRejected(record->source);
+  }
+
   if (r.status_code >= 300 || r.status_code < 200)
     throw "Error fetching image";
 
@@ -124,6 +201,7 @@ vector<string> ImagesManager::getImage(const string &id, const string &genre,
     throw "Failed to load image";
 
   // cache the image
+  filesystem::create_directories(filesystem::path(imagePath).parent_path());
   FIBITMAP *converted_dib = FreeImage_ConvertTo24Bits(dib);
   if (!FreeImage_Save(FIF_FORMAT, converted_dib, imagePath.c_str()))
     throw "Failed to save image";
@@ -132,9 +210,46 @@ vector<string> ImagesManager::getImage(const string &id, const string &genre,
   FreeImage_Unload(dib);
   FreeImage_CloseMemory(hmem);
 
+  store.setCached(id, genre, hashWithoutExtension,
+                  filesystem::file_size(imagePath));
+
   return this->getImage(id, genre, hash, asBase64);
 }
 
+void ImagesManager::getImageAsync(const string &id, const string &genre,
+                                  const string &hash, bool asBase64,
+                                  function<void(vector<string>)> onDone) {
+  string key = fmt::format("{}/{}/{}/{}", id, genre, hash, (int)asBase64);
+
+  // join the fetch in flight instead of taking another thread to wait for it
+  unique_lock<std::mutex> guard(fetchesMutex);
+  auto it = fetches.find(key);
+  if (it != fetches.end()) {
+    it->second.push_back(std::move(onDone));
+    return;
+  }
+
+  fetches[key].push_back(std::move(onDone));
+  guard.unlock();
+
+  fetchPool->submit([this, id, genre, hash, asBase64, key] {
+    vector<string> result;
+    try {
+      result = getImage(id, genre, hash, asBase64);
+    } catch (...) {
+    }
+
+    unique_lock<std::mutex> guard(fetchesMutex);
+    vector<function<void(vector<string>)>> callbacks =
+        std::move(fetches[key]);
+    fetches.erase(key);
+    guard.unlock();
+
+    for (const auto &callback : callbacks)
+      callback(result);
+  });
+}
+
 string ImagesManager::saveImage(const string &id, const string &genre,
                                 const string &image) {
   filesystem::create_directories(fmt::format("../image/{}/{}", id, genre));
@@ -195,59 +310,13 @@ void ImagesManager::deleteImage(const string &id, const string &genre,
   filesystem::remove(imagePath);
 }
 
-void ImagesManager::setInterval(string interval) {
-  if (this->interval != nullptr)
-    return;
-
-  // extract the value and unit
-  int value;
-  char unit;
-  stringstream ss(interval);
-  ss >> value;
-  ss >> unit;
-  if (ss.fail())
-    return;
-
-  // convert unit to minutes
-  switch (unit) {
-  case 'h':
-    value *= 60;
-    break;
-  case 'd':
-    value *= 1440;
-    break;
-  }
-
-  this->interval = new int(value);
-  thread(&ImagesManager::cleaner, this).detach();
+void ImagesManager::setCacheSize(
+    unsigned long long bytes, const map<string, unsigned long long> &quotas) {
+  store.setCapacity(bytes);
+  for (const auto &pair : quotas)
+    store.setQuota(pair.first, pair.second);
 }
 
-void ImagesManager::cleaner() {
-  string path = "../image";
-
-  function<void(filesystem::path)> processFile =
-      [](const filesystem::path &filePath) {
-        if (filePath.extension() != ".src")
-          filesystem::remove(filePath);
-      };
-
-  function<void(filesystem::path)> processDirectory =
-      [&processDirectory, &processFile](const filesystem::path &dirPath) {
-        for (const auto &entry : filesystem::directory_iterator(dirPath)) {
-          if (entry.is_directory())
-            processDirectory(entry.path());
-          else if (entry.is_regular_file())
-            processFile(entry.path());
-        }
-      };
-
-  while (true) {
-    log("ImagesManager", "Clearing Image Cache");
-    if (filesystem::exists(path) && filesystem::is_directory(path))
-      processDirectory(path);
-
-    this_thread::sleep_for(chrono::minutes(*this->interval));
-  }
-}
+json ImagesManager::getStats() { return store.getStats(); }
 
 ImagesManager imagesManager;
\ No newline at end of file
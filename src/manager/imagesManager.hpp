@@ -1,12 +1,21 @@
 #pragma once
 
+#include "../utils/threadPool.hpp"
+#include "imageStore.hpp"
+
 #include <cpr/cpr.h>
+#include <functional>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <unordered_map>
 
 using json = nlohmann::json;
 using namespace std;
 
+// The default size limit of the cached images in bytes.
+#define DEFAULT_IMAGE_CACHE_SIZE (10ULL * 1024 * 1024 * 1024)
+
 struct CaseInsensitiveCompare {
   bool operator()(const string &str1, const string &str2) const {
     string str1_lower, str2_lower;
@@ -23,6 +32,8 @@ struct CaseInsensitiveCompare {
 // This class is used to manage the images
 class ImagesManager {
 public:
+  ImagesManager();
+
   // This should not be called directly.
   void add(string id, cpr::Header headers);
 
@@ -34,11 +45,19 @@ public:
   // images.
   void setProxy(string proxy);
 
-  // This is a setter for the interval between clearing the cache.
-  void setInterval(string interval);
+  // Load the index of the images. This should be called after the drivers
+  // are added.
+  void open();
 
-  // This should not be called directly.
-  void cleaner();
+  // This is a setter for the number of threads fetching the images.
+  void setFetchThreads(int threads);
+
+  // This is a setter for the size limit of the cached images in bytes. The
+  // least recently used images are removed once it is exceeded. Set it to 0
+  // to remove the limit.
+  // The quotas limit the cached images of each driver in the same way.
+  void setCacheSize(unsigned long long bytes,
+                    const map<string, unsigned long long> &quotas);
 
   // Get the full path to the image.
   string getPath(const string &id, const string &genre, const string &dest,
@@ -48,21 +67,43 @@ public:
   string getLocalPath(const string &id, const string &genre, const string &dest,
                       const string &baseUrl);
 
+  // Get the path to the cached image and when it was cached in seconds since
+  // the epoch, so it can be sent as a file. Return false if it is not cached.
+  bool getCachedImage(const string &id, const string &genre,
+                      const string &hash, string &path,
+                      long long &modifiedTime);
+
   // Get the image data.
   vector<string> getImage(const string &id, const string &genre,
                           const string &hash, bool asBase64);
 
+  // Get the image data on a fetching thread, so the caller is not blocked by
+  // the upstream. onDone is called on that thread with the image data, or
+  // with an empty vector if it failed.
+  // The concurrent requests of the same image share a single fetch, so a
+  // burst of them takes only one thread.
+  void getImageAsync(const string &id, const string &genre, const string &hash,
+                     bool asBase64, function<void(vector<string>)> onDone);
+
   // Save a image to the local storage
   string saveImage(const string &id, const string &genre, const string &image);
 
   // Remove the image from the local storage
   void deleteImage(const string &id, const string &genre, const string &hash);
 
+  // Return the runtime statistics of the cached images.
+  json getStats();
+
 private:
   map<string, cpr::Header, CaseInsensitiveCompare> settings;
   string *proxy;
   string url;
-  int *interval;
+  ImageStore store;
+  ThreadPool *fetchPool = nullptr;
+  std::mutex fetchesMutex;
+  // The callbacks waiting for each image being fetched, keyed by the image
+  // and its encoding.
+  unordered_map<string, vector<function<void(vector<string>)>>> fetches;
 };
 
 extern ImagesManager imagesManager;
\ No newline at end of file
@@ -15,6 +15,15 @@ public:
   // The timeout of each fetch request.
   int timeout;
 
+  // The bounds of the interval between the polls of the updates in seconds.
+  // The interval adapts to how often the upstream updates.
+  int minUpdateInterval = 60;
+  int maxUpdateInterval = 1800;
+
+  // How long the urls of a chapter stay fresh in seconds, 0 means forever.
+  // The stale urls are still served while they are refreshed.
+  int urlTtl = 0;
+
   // Get the updated manga
   virtual vector<PreviewManga> getUpdates(string proxy = "") = 0;
 
@@ -24,6 +33,9 @@ public:
   virtual vector<string> getChapter(string id, string extraData,
                                     string proxy) = 0;
 
+  virtual vector<Manga *> getList(Genre genre, int page, Status status,
+                                  string proxy) = 0;
+
   // This function is used to specify the appropriate way to compare the latest
   // title.
   virtual bool isLatestEqual(string value1, string value2) {
@@ -38,4 +50,8 @@ public:
   vector<string> getChapter(string id, string extraData) override {
     return this->getChapter(id, extraData, "");
   };
+
+  vector<Manga *> getList(Genre genre, int page, Status status) override {
+    return this->getList(genre, page, status, "");
+  };
 };
\ No newline at end of file
@@ -55,6 +55,13 @@ public:
     return imagesManager.getPath(id, genre, dest, baseUrl);
   }
 
+  // This function is called when the upstream rejects an image proxied for the
+  // driver, the url may have expired.
+  virtual void onImageRejected(const string &url) {}
+
   // The corresponding config will be passed to this function.
   virtual void applyConfig(json config) {}
+
+  // Return the runtime statistics of the driver, such as the cache usage.
+  virtual json getStats() { return json::object(); }
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -57,6 +58,16 @@ static string genreString[] = {
 
 static string genreToString(Genre genre) { return genreString[genre]; }
 
+// Convert the genres into a bitmask, each genre is stored at the bit of its
+// value.
+static long long genresToMask(const vector<Genre> &genres) {
+  long long mask = 0;
+  for (const auto &genre : genres)
+    mask |= 1LL << genre;
+
+  return mask;
+}
+
 static Genre stringToGenre(string genre) {
   for (int i = 0; i < sizeof(genreString) / sizeof(genreString[0]); i++) {
     if (genre == genreString[i])
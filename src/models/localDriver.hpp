@@ -1,11 +1,21 @@
 #pragma once
 
 #include "../manager/driversManager.hpp"
+#include "../utils/cursor.hpp"
 #include "../utils/log.hpp"
+#include "../utils/lruCache.hpp"
+#include "../utils/sqliteProfile.hpp"
+#include "../utils/statementCache.hpp"
+#include "../utils/threadPool.hpp"
+#include "../utils/trigramIndex.hpp"
 #include "../utils/utils.hpp"
 #include "baseDriver.hpp"
 #include "manga.hpp"
+#include "mangaCatalog.hpp"
 
+#include <atomic>
+#include <numeric>
+#include <optional>
 #include <rapidfuzz/fuzz.hpp>
 #include <soci/soci.h>
 
@@ -22,49 +32,69 @@ using namespace soci;
 #define CREATE_CHAPTER_TABLES_SQL                                              \
   R"(CREATE TABLE IF NOT EXISTS "CHAPTER" ("MANGA_ID" VARCHAR(255) NOT NULL, "ID" VARCHAR(255) NOT NULL, "IDX" INTEGER NOT NULL, "IS_EXTRA" INTEGER NOT NULL, "TITLE" VARCHAR(255) NOT NULL, "URLS" TEXT, PRIMARY KEY ("MANGA_ID", "ID"), FOREIGN KEY ("MANGA_ID") REFERENCES "MANGA" ("ID")); CREATE INDEX "chaptermodel_MANGA_ID" ON "CHAPTER" ("MANGA_ID");)"
 
+#define CREATE_CHAPTER_IMAGE_TABLE_SQL                                         \
+  R"(CREATE TABLE IF NOT EXISTS "CHAPTER_IMAGE" ("MANGA_ID" VARCHAR(255) NOT NULL, "CHAPTER_ID" VARCHAR(255) NOT NULL, "IDX" INTEGER NOT NULL, "REF" TEXT NOT NULL, PRIMARY KEY ("MANGA_ID", "CHAPTER_ID", "IDX"));)"
+
+// Append the refs in the json array after the last image of the chapter.
+// Nothing is inserted if the chapter does not exist.
+#define APPEND_CHAPTER_IMAGES_SQL                                              \
+  R"(INSERT INTO CHAPTER_IMAGE (MANGA_ID, CHAPTER_ID, IDX, REF) SELECT C.MANGA_ID, C.ID, (SELECT COALESCE(MAX(IDX) + 1, 0) FROM CHAPTER_IMAGE WHERE MANGA_ID = C.MANGA_ID AND CHAPTER_ID = C.ID) + J.key, J.value FROM CHAPTER C, json_each(:refs) J WHERE C.MANGA_ID = :manga_id AND C.ID = :id)"
+
+#define CREATE_CHAPTER_IMAGE_REF_INDEX_SQL                                     \
+  R"(CREATE INDEX IF NOT EXISTS "chapterimage_REF" ON "CHAPTER_IMAGE" ("REF");)"
+
+#define CREATE_UPDATE_TIME_ID_INDEX_SQL                                        \
+  R"(CREATE INDEX IF NOT EXISTS "mangamodel_UPDATE_TIME_ID" ON "MANGA" ("UPDATE_TIME" DESC, "ID" DESC);)"
+
+#define CREATE_IS_ENDED_UPDATE_TIME_ID_INDEX_SQL                               \
+  R"(CREATE INDEX IF NOT EXISTS "mangamodel_IS_ENDED_UPDATE_TIME_ID" ON "MANGA" ("IS_ENDED", "UPDATE_TIME" DESC, "ID" DESC);)"
+
+// The number of incremental refreshes between full reloads of the titles.
+// Full reloads are needed to pick up deleted manga and edited titles that did
+// not bump the UPDATE_TIME.
+#define TITLES_FULL_RELOAD_INTERVAL 12
+
+// The default number of titles to be scored before the scoring is split
+// across the search workers.
+#define DEFAULT_PARALLEL_SEARCH_THRESHOLD 50000
+
+#define SELECT_CATALOG_SQL                                                     \
+  "SELECT ID, TITLE, THUMBNAIL, LATEST, IS_ENDED, GENRE_MASK, UPDATE_TIME "    \
+  "FROM MANGA"
+
+// The default size of the manga cache in bytes.
+#define DEFAULT_MANGA_CACHE_SIZE (64 * 1024 * 1024)
+
+// An immutable snapshot of the cached titles.
+struct TitlesSnapshot {
+  // The title of each manga id.
+  unordered_map<string, string> titleOfId;
+  map<string, vector<string>> titlesWithId;
+  // The unique titles, indexed by titlesIndex.
+  vector<string> titles;
+  TrigramIndex titlesIndex;
+};
+
 class LocalDriver : public BaseDriver {
 public:
   virtual vector<Manga *> getManga(vector<string> ids,
                                    bool showDetails) override {
     CHECK_ONLINE()
 
-    vector<string> filteredIds;
-    for (const auto &id : ids)
-      // prevent SQL injection
-      if (RE2::FullMatch(id, R"(^[A-Za-z0-9\-_.~!#$&'()*+,\/:;=?@\[\]]*$)"))
-        filteredIds.push_back(id);
-
-    session sql(*pool);
-    rowset<row> rs = sql.prepare
-                     << fmt::format("SELECT * FROM MANGA WHERE ID IN ('{}')",
-                                    fmt::join(filteredIds, "','"));
-
+    // serve the cached manga and only query the rest
     map<string, Manga *> resultMap;
-    for (auto it = rs.begin(); it != rs.end(); it++) {
-      const row &row = *it;
-      Manga *manga = toManga(row, showDetails);
-      resultMap[manga->id] = manga;
+    vector<string> missingIds;
+    for (const auto &id : ids) {
+      optional<shared_ptr<const Manga>> cached =
+          mangaCache.get(mangaCacheKey(id, showDetails));
+      if (cached.has_value())
+        resultMap[id] = (*cached)->clone();
+      else
+        missingIds.push_back(id);
     }
 
-    if (showDetails) {
-      // Get the chapters
-      rs = sql.prepare << fmt::format("SELECT * FROM CHAPTER WHERE MANGA_ID IN "
-                                      "('{}') ORDER BY MANGA_ID, -IDX",
-                                      fmt::join(filteredIds, "','"));
-
-      for (auto it = rs.begin(); it != rs.end(); it++) {
-        const row &row = *it;
-
-        Chapter chapter = {row.get<string>("TITLE"), row.get<string>("ID")};
-
-        if (row.get<int>("IS_EXTRA") == 1)
-          ((DetailsManga *)resultMap[row.get<string>("MANGA_ID")])
-              ->chapters.extra.push_back(chapter);
-        else
-          ((DetailsManga *)resultMap[row.get<string>("MANGA_ID")])
-              ->chapters.serial.push_back(chapter);
-      }
-    }
+    if (!missingIds.empty())
+      queryManga(missingIds, showDetails, resultMap);
 
     vector<Manga *> result;
     // convert it to vector of manga
@@ -78,38 +108,70 @@ public:
   virtual vector<string> getChapter(string id, string extraData) override {
     CHECK_ONLINE()
 
-    session sql(*pool);
-    string urls;
-    indicator ind;
-    sql << "SELECT URLS FROM CHAPTER WHERE ID = :id AND MANGA_ID = :manga_id",
-        into(urls, ind), use(id), use(extraData);
-
-    if (ind == i_null)
-      return {};
+    vector<string> refs;
+    statements.query(*pool,
+                     "SELECT REF FROM CHAPTER_IMAGE WHERE CHAPTER_ID = :id "
+                     "AND MANGA_ID = :manga_id ORDER BY IDX",
+                     {id, extraData}, [&](const row &row) {
+                       refs.push_back(row.get<string>("REF"));
+                     });
 
-    return split(urls, R"(\|)");
+    return refs;
   }
 
   virtual vector<Manga *> getList(Genre genre, int page,
                                   Status status) override {
+    string nextCursor;
+    return getList(genre, status, "", nextCursor, page);
+  }
+
+  // Return a list of manga starting right after the given cursor, or at the
+  // given page if the cursor is empty.
+  // The cursor of the next page is written to nextCursor. It will be empty if
+  // there are no more manga.
+  vector<Manga *> getList(Genre genre, Status status, const string &cursor,
+                          string &nextCursor, int page = 1) {
     CHECK_ONLINE()
 
-    string queryString = "SELECT * FROM MANGA";
-    if (status != Any)
-      queryString += " WHERE IS_ENDED = " + to_string(status == Ended);
-    if (genre != All)
-      queryString += (status == Any ? " WHERE" : " AND") +
-                     (" GENRES LIKE '%" + genreToString(genre) + "%'");
-    queryString += " ORDER BY -UPDATE_TIME LIMIT 50 OFFSET :offset";
+    if (catalogReady)
+      return getListFromCatalog(genre, status, cursor, nextCursor, page);
 
-    session sql(*pool);
-    rowset<row> rs = (sql.prepare << queryString, use((page - 1) * 50));
+    vector<string> conditions;
+    vector<StatementParam> params;
+    if (status != Any) {
+      conditions.push_back("IS_ENDED = :is_ended");
+      params.push_back((long long)(status == Ended));
+    }
+    if (genre != All) {
+      conditions.push_back("(GENRE_MASK & :genre_mask) != 0");
+      params.push_back(genresToMask({genre}));
+    }
+    if (!cursor.empty()) {
+      // seek to the row right after the cursor
+      json position = decodeCursor(cursor);
+      conditions.push_back("(UPDATE_TIME, ID) < (:update_time, :id)");
+      params.push_back(position["u"].get<long long>());
+      params.push_back(position["i"].get<string>());
+    }
+
+    string queryString = "SELECT * FROM MANGA";
+    if (!conditions.empty())
+      queryString += fmt::format(" WHERE {}", fmt::join(conditions, " AND "));
+    // walk the update time index and stop after the page is filled
+    queryString += " ORDER BY UPDATE_TIME DESC, ID DESC LIMIT 50";
+    if (cursor.empty()) {
+      queryString += " OFFSET :offset";
+      params.push_back((long long)(page - 1) * 50);
+    }
 
     vector<Manga *> result;
-    for (auto it = rs.begin(); it != rs.end(); it++) {
-      const row &row = *it;
+    json last;
+    statements.query(*pool, queryString, params, [&](const row &row) {
       result.push_back(toManga(row));
-    }
+      last = {{"u", row.get<int>("UPDATE_TIME")}, {"i", row.get<string>("ID")}};
+    });
+
+    nextCursor = result.size() == 50 ? encodeCursor(last) : "";
 
     return result;
   }
@@ -121,8 +183,20 @@ public:
   }
 
   virtual vector<Manga *> search(string keyword, int page) override {
+    string nextCursor;
+    return search(keyword, "", nextCursor, page);
+  }
+
+  // Return the search result starting right after the given cursor, or at the
+  // given page if the cursor is empty.
+  // The cursor of the next page is written to nextCursor. It will be empty if
+  // there are no more results.
+  vector<Manga *> search(string keyword, const string &cursor,
+                         string &nextCursor, int page = 1) {
     CHECK_ONLINE()
 
+    nextCursor = "";
+
     // if the keyword is int, treat it as an id
     try {
       int id = stoi(keyword);
@@ -130,16 +204,32 @@ public:
     } catch (...) {
     }
 
-    vector<string> titlesRank = extract(keyword, page * 50);
-    vector<string> resultTitles;
-    int padding = (page - 1) * 50;
-    if (titlesRank.size() >= padding)
-      resultTitles = vector(titlesRank.begin() + padding, titlesRank.end());
+    shared_ptr<const TitlesSnapshot> snapshot = titlesSnapshot.load();
+
+    vector<pair<double, string>> ranked;
+    if (cursor.empty()) {
+      ranked = rank(*snapshot, keyword, page * 50);
+      size_t padding = (page - 1) * 50;
+      ranked.erase(ranked.begin(),
+                   ranked.begin() + min(padding, ranked.size()));
+    } else {
+      // only the titles ranked after the cursor are kept, so the cost does
+      // not grow with the depth of the page
+      json position = decodeCursor(cursor);
+      ranked = rank(*snapshot, keyword, 50,
+                    make_pair(position["s"].get<double>(),
+                              position["t"].get<string>()));
+    }
+
+    if (ranked.size() == 50)
+      nextCursor = encodeCursor(
+          {{"s", ranked.back().first}, {"t", ranked.back().second}});
 
     vector<string> resultId;
-    for (const auto &title : resultTitles)
-      resultId.insert(resultId.end(), titlesWithId[title].begin(),
-                      titlesWithId[title].end());
+    for (const auto &entry : ranked) {
+      const vector<string> &ids = snapshot->titlesWithId.at(entry.second);
+      resultId.insert(resultId.end(), ids.begin(), ids.end());
+    }
 
     // remove duplicates
     sort(resultId.begin(), resultId.end());
@@ -150,21 +240,103 @@ public:
 
   virtual bool checkOnline() override { return isOnline; }
 
+  virtual json getStats() override {
+    json stats;
+    stats["statementCache"] = {{"hits", statements.hits()},
+                               {"misses", statements.misses()}};
+
+    unsigned long long hits = mangaCache.hits();
+    unsigned long long lookups = hits + mangaCache.misses();
+    stats["mangaCache"] = {
+        {"hits", hits},
+        {"misses", mangaCache.misses()},
+        {"hitRatio", lookups == 0 ? 0.0 : (double)hits / lookups},
+        {"entries", mangaCache.size()},
+        {"bytes", mangaCache.bytes()},
+        {"capacity", mangaCache.getCapacity()}};
+
+    return stats;
+  }
+
   virtual void applyConfig(json config) override {
     if (config.contains("parameters"))
       parameters = config["parameters"].get<string>();
 
     if (config.contains("sql"))
       sqlName = config["sql"].get<string>();
+
+    if (config.contains("sqlite"))
+      sqliteProfile = SqliteProfile::fromJson(config["sqlite"]);
+
+    if (config.contains("parallelSearchThreshold"))
+      parallelSearchThreshold = config["parallelSearchThreshold"].get<int>();
+
+    if (config.contains("searchThreads"))
+      searchThreads = config["searchThreads"].get<int>();
+
+    if (config.contains("mangaCacheSize"))
+      mangaCache.setCapacity(config["mangaCacheSize"].get<size_t>());
+
+    if (config.contains("memoryCatalog"))
+      useMemoryCatalog = config["memoryCatalog"].get<bool>();
+  }
+
+  // Drop the cached copies of the manga with the given id and reload its row
+  // of the catalog.
+  // This must be called after every write to the manga or its chapters.
+  void onMangaChanged(const string &mangaId) {
+    mangaCacheGeneration++;
+    mangaCache.erase(mangaCacheKey(mangaId, false));
+    mangaCache.erase(mangaCacheKey(mangaId, true));
+
+    if (!catalogReady)
+      return;
+
+    try {
+      optional<CatalogEntry> entry;
+      statements.query(*pool, string(SELECT_CATALOG_SQL) + " WHERE ID = :id",
+                       {mangaId},
+                       [&](const row &row) { entry = toCatalogEntry(row); });
+
+      if (entry.has_value())
+        catalog.upsert(std::move(*entry));
+      else
+        catalog.erase(mangaId);
+    } catch (...) {
+      // the catalog can't be trusted anymore, fall back to the database
+      catalogReady = false;
+      log(id, "Failed to Update the Catalog");
+    }
   }
 
 protected:
   bool isOnline = true;
   connection_pool *pool;
+  // The prepared statements of the hot read paths.
+  StatementCache statements;
   string parameters;
   string sqlName = "sqlite3";
-  map<string, vector<string>> titlesWithId;
-  vector<string> titles;
+  SqliteProfile sqliteProfile;
+  // Scoring is done in parallel only if the number of titles to be scored
+  // reaches this threshold. Set it to 0 to disable the parallel scoring.
+  int parallelSearchThreshold = DEFAULT_PARALLEL_SEARCH_THRESHOLD;
+  int searchThreads = thread::hardware_concurrency();
+  ThreadPool *searchPool = nullptr;
+  // Readers load the snapshot and never block, the refresh loop publishes a
+  // new one.
+  atomic<shared_ptr<const TitlesSnapshot>> titlesSnapshot{
+      make_shared<const TitlesSnapshot>()};
+  // The decoded manga, keyed by the driver id, manga id, and showDetails.
+  LruCache<shared_ptr<const Manga>> mangaCache{DEFAULT_MANGA_CACHE_SIZE};
+  atomic<unsigned long long> mangaCacheGeneration = 0;
+  // Serve the list from the in-memory catalog instead of the database.
+  bool useMemoryCatalog = false;
+  MangaCatalog catalog;
+  atomic<bool> catalogReady = false;
+
+  string mangaCacheKey(const string &mangaId, bool showDetails) {
+    return fmt::format("{}\u001D{}\u001D{}", id, mangaId, (int)showDetails);
+  }
 
   void initializeDatabase() {
     while (!driversManager.isReady)
@@ -181,11 +353,26 @@ protected:
       for (size_t i = 0; i != poolSize; ++i) {
         session &sql = pool->at(i);
         sql.open(sqlName, parameters);
+
+        if (sqlName == "sqlite3")
+          sqliteProfile.apply(sql);
       }
 
       session sql(*pool);
       sql << CREATE_MANGA_TABLES_SQL;
       sql << CREATE_CHAPTER_TABLES_SQL;
+      sql << CREATE_CHAPTER_IMAGE_TABLE_SQL;
+
+      if (sqlName == "sqlite3") {
+        migrateDatabase(sql);
+        sqliteProfile.startMaintenance(pool, id);
+      }
+
+      if (useMemoryCatalog)
+        loadCatalog();
+
+      if (parallelSearchThreshold > 0 && searchThreads > 1)
+        searchPool = new ThreadPool(searchThreads);
 
       thread(&LocalDriver::titlesCacheUpdateLoop, this).detach();
     } catch (...) {
@@ -196,6 +383,210 @@ protected:
       log(id, "Failed to Connect to the Database");
   }
 
+  // Bring the schema of the database up to date.
+  // Each migration runs once, the applied version is kept in the user_version.
+  void migrateDatabase(session &sql) {
+    int version = 0;
+    sql << "PRAGMA user_version", into(version);
+
+    vector<function<void()>> migrations = {
+        // 1: store the genres as a bitmask and index the order of the list,
+        // the ties are broken by the id for the cursors
+        [&] {
+          sql << "ALTER TABLE MANGA ADD COLUMN GENRE_MASK INTEGER NOT NULL "
+                 "DEFAULT 0";
+
+          vector<pair<string, long long>> masks;
+          rowset<row> rs = sql.prepare << "SELECT ID, GENRES FROM MANGA";
+          for (auto it = rs.begin(); it != rs.end(); it++) {
+            const row &row = *it;
+
+            vector<Genre> genres;
+            for (string genre : split(row.get<string>("GENRES"), R"(\|)"))
+              genres.push_back(stringToGenre(genre));
+
+            masks.emplace_back(row.get<string>("ID"), genresToMask(genres));
+          }
+
+          string mangaId;
+          long long mask;
+          statement st = (sql.prepare << "UPDATE MANGA SET GENRE_MASK = :mask "
+                                         "WHERE ID = :id",
+                          use(mask), use(mangaId));
+          for (const auto &pair : masks) {
+            mangaId = pair.first;
+            mask = pair.second;
+            st.execute(true);
+          }
+
+          sql << CREATE_UPDATE_TIME_ID_INDEX_SQL;
+          sql << CREATE_IS_ENDED_UPDATE_TIME_ID_INDEX_SQL;
+        },
+        // 2: move the urls of the chapters into their own table, URLS is only
+        // kept to mark the chapters whose urls have been fetched
+        [&] {
+          sql << CREATE_CHAPTER_IMAGE_TABLE_SQL;
+
+          vector<tuple<string, string, string>> chapters;
+          rowset<row> rs = sql.prepare << "SELECT MANGA_ID, ID, URLS FROM "
+                                          "CHAPTER WHERE URLS != ''";
+          for (auto it = rs.begin(); it != rs.end(); it++) {
+            const row &row = *it;
+            chapters.emplace_back(row.get<string>("MANGA_ID"),
+                                  row.get<string>("ID"),
+                                  json(split(row.get<string>("URLS"), R"(\|)"))
+                                      .dump());
+          }
+
+          for (const auto &[mangaId, chapterId, refs] : chapters)
+            sql << APPEND_CHAPTER_IMAGES_SQL, use(refs), use(mangaId),
+                use(chapterId);
+
+          sql << "UPDATE CHAPTER SET URLS = '' WHERE URLS IS NOT NULL";
+        },
+        // 3: record when the urls of the chapters were resolved, and find the
+        // chapters of the images by their urls
+        [&] {
+          sql << "ALTER TABLE CHAPTER ADD COLUMN RESOLVED_TIME INTEGER";
+          // the urls fetched before are treated as fetched now, so they are
+          // not all refreshed ahead of the updates on their first reads
+          sql << "UPDATE CHAPTER SET RESOLVED_TIME = CAST(strftime('%s', "
+                 "'now') AS INTEGER) WHERE URLS IS NOT NULL";
+          sql << CREATE_CHAPTER_IMAGE_REF_INDEX_SQL;
+        },
+        // 4: record the hash of the crawled content to skip the unchanged
+        // manga
+        [&] { sql << "ALTER TABLE MANGA ADD COLUMN CONTENT_HASH TEXT"; },
+    };
+
+    for (int i = version; i < migrations.size(); i++) {
+      transaction tr(sql);
+      migrations[i]();
+      sql << fmt::format("PRAGMA user_version = {}", i + 1);
+      tr.commit();
+
+      log(id, fmt::format("Migrated the Database to Version {}", i + 1));
+    }
+  }
+
+  // Query the manga with the given ids into resultMap and cache them.
+  void queryManga(const vector<string> &ids, bool showDetails,
+                  map<string, Manga *> &resultMap) {
+    // rows read before an invalidation may be stale, don't cache them
+    unsigned long long generation = mangaCacheGeneration;
+
+    // the ids are bound as a json array, so the statement is the same
+    // regardless of the number of ids
+    string idsJson = json(ids).dump();
+
+    statements.query(*pool,
+                     "SELECT * FROM MANGA WHERE ID IN (SELECT value FROM "
+                     "json_each(:ids))",
+                     {idsJson}, [&](const row &row) {
+                       Manga *manga = toManga(row, showDetails);
+                       resultMap[manga->id] = manga;
+                     });
+
+    if (showDetails) {
+      // Get the chapters
+      statements.query(
+          *pool,
+          "SELECT * FROM CHAPTER WHERE MANGA_ID IN (SELECT value FROM "
+          "json_each(:ids)) ORDER BY MANGA_ID, -IDX",
+          {idsJson}, [&](const row &row) {
+            Chapter chapter = {row.get<string>("TITLE"),
+                               row.get<string>("ID")};
+
+            if (row.get<int>("IS_EXTRA") == 1)
+              ((DetailsManga *)resultMap[row.get<string>("MANGA_ID")])
+                  ->chapters.extra.push_back(chapter);
+            else
+              ((DetailsManga *)resultMap[row.get<string>("MANGA_ID")])
+                  ->chapters.serial.push_back(chapter);
+          });
+    }
+
+    if (generation != mangaCacheGeneration)
+      return;
+
+    // the returned manga are owned by the caller, so cache a copy. The
+    // generation is checked again under the lock of the cache, as a write may
+    // land between the check above and the put
+    auto isCurrent = [&] { return generation == mangaCacheGeneration; };
+    for (const auto &id : ids) {
+      auto it = resultMap.find(id);
+      if (it != resultMap.end())
+        mangaCache.put(mangaCacheKey(id, showDetails),
+                       shared_ptr<const Manga>(it->second->clone()),
+                       it->second->bytes(), isCurrent);
+    }
+  }
+
+  // Append the refs to the images of the chapter.
+  // Return the number of appended images, it will be 0 if the chapter does not
+  // exist.
+  long long appendChapterImages(session &sql, const string &id,
+                                const string &extraData,
+                                const vector<string> &refs) {
+    string refsJson = json(refs).dump();
+    statement st = (sql.prepare << APPEND_CHAPTER_IMAGES_SQL, use(refsJson),
+                    use(extraData), use(id));
+    st.execute(true);
+
+    return st.get_affected_rows();
+  }
+
+  void loadCatalog() {
+    vector<CatalogEntry> entries;
+    statements.query(*pool, SELECT_CATALOG_SQL, {}, [&](const row &row) {
+      entries.push_back(toCatalogEntry(row));
+    });
+
+    catalog.load(std::move(entries));
+    catalogReady = true;
+
+    log(id, fmt::format("Loaded {} Manga into the Catalog", catalog.size()));
+  }
+
+  static CatalogEntry toCatalogEntry(const row &row) {
+    // the genres fit in the lower bits, so the mask is read as an int
+    return {row.get<string>("ID"),
+            row.get<string>("TITLE"),
+            row.get<string>("THUMBNAIL"),
+            row.get<string>("LATEST"),
+            row.get<int>("IS_ENDED") == 1,
+            row.get<int>("GENRE_MASK"),
+            row.get<int>("UPDATE_TIME")};
+  }
+
+  // The catalog version of getList.
+  vector<Manga *> getListFromCatalog(Genre genre, Status status,
+                                     const string &cursor, string &nextCursor,
+                                     int page) {
+    optional<pair<int, string>> after;
+    if (!cursor.empty()) {
+      json position = decodeCursor(cursor);
+      after = make_pair(position["u"].get<int>(), position["i"].get<string>());
+    }
+
+    vector<CatalogEntry> entries = catalog.scan(
+        genre == All ? 0 : genresToMask({genre}),
+        status == Any ? -1 : status == Ended ? 0 : 1, after,
+        cursor.empty() ? (page - 1) * 50 : 0, 50);
+
+    vector<Manga *> result;
+    for (const auto &entry : entries)
+      result.push_back(new Manga(this, entry.id, entry.title, entry.thumbnail,
+                                 entry.latest, entry.isEnded));
+
+    nextCursor = entries.size() == 50
+                     ? encodeCursor({{"u", entries.back().updateTime},
+                                     {"i", entries.back().id}})
+                     : "";
+
+    return result;
+  }
+
   Manga *toManga(const row &row, bool showDetails = false) {
     if (showDetails) {
       vector<Genre> genres;
@@ -217,47 +608,194 @@ protected:
   }
 
   vector<string> extract(string keyword, int limit = 5) {
-    vector<pair<double, string>> top_titles;
-    rapidfuzz::fuzz::CachedRatio scorer(keyword);
-
-    for (const auto &title : titles) {
-      double score = scorer.similarity(title);
-
-      if (top_titles.size() < limit) {
-        top_titles.emplace_back(score, title);
-        sort(top_titles.begin(), top_titles.end(), greater<>());
-      } else if (score > top_titles.back().first) {
-        top_titles.back() = make_pair(score, title);
-        sort(top_titles.begin(), top_titles.end(), greater<>());
-      }
-    }
+    return extract(*titlesSnapshot.load(), keyword, limit);
+  }
 
+  vector<string> extract(const TitlesSnapshot &snapshot, string keyword,
+                         int limit) {
     vector<string> result;
-    for (const auto &entry : top_titles)
+    for (const auto &entry : rank(snapshot, keyword, limit))
       result.push_back(entry.second);
 
     return result;
   }
 
+  // Return the best titles with their scores, best first.
+  // Only the titles ranked after the given entry are returned if it is given.
+  // A keyword of 3 code points or more only scores the titles sharing a
+  // trigram with it, so the ranking is approximate: a title scoring well
+  // without sharing any trigram is missed. The shorter keywords, and the
+  // keywords with fewer candidates than the limit, score every title.
+  vector<pair<double, string>>
+  rank(const TitlesSnapshot &snapshot, string keyword, int limit,
+       const optional<pair<double, string>> &after = nullopt) {
+    if (limit <= 0)
+      return {};
+
+    // a shorter keyword only has the padded trigrams, which only match the
+    // titles starting or ending with it
+    vector<uint32_t> positions;
+    if (TrigramIndex::isSelective(keyword))
+      positions = snapshot.titlesIndex.candidates(keyword);
+
+    if (positions.size() < limit) {
+      positions.resize(snapshot.titles.size());
+      iota(positions.begin(), positions.end(), 0);
+    }
+
+    vector<pair<double, string>> result;
+    for (const auto &entry : score(snapshot, keyword, positions, limit, after))
+      result.emplace_back(entry.first, *entry.second);
+
+    return result;
+  }
+
 private:
-  void updateCaches() {
+  using Scored = pair<double, const string *>;
+
+  // The better of the scored titles, the ties are broken by the titles.
+  static bool isBetter(const Scored &a, const Scored &b) {
+    return a.first != b.first ? a.first > b.first : *a.second > *b.second;
+  }
+
+  // Score the titles at the given positions and return the best of them, best
+  // first.
+  vector<Scored> score(const TitlesSnapshot &snapshot, const string &keyword,
+                       const vector<uint32_t> &positions, int limit,
+                       const optional<pair<double, string>> &after) {
+    Scored afterScored;
+    if (after.has_value())
+      afterScored = {after->first, &after->second};
+
+    // keep the best titles of the range in a bounded min-heap
+    auto scoreRange = [&](size_t begin, size_t end) {
+      rapidfuzz::fuzz::CachedRatio scorer(keyword);
+      vector<Scored> heap;
+      heap.reserve(min<size_t>(limit, end - begin));
+
+      for (size_t i = begin; i < end; i++) {
+        const string &title = snapshot.titles[positions[i]];
+        Scored scored = {scorer.similarity(title), &title};
+
+        if (after.has_value() && !isBetter(afterScored, scored))
+          continue;
+
+        if (heap.size() < limit) {
+          heap.push_back(scored);
+          push_heap(heap.begin(), heap.end(), isBetter);
+        } else if (isBetter(scored, heap.front())) {
+          pop_heap(heap.begin(), heap.end(), isBetter);
+          heap.back() = scored;
+          push_heap(heap.begin(), heap.end(), isBetter);
+        }
+      }
+
+      return heap;
+    };
+
+    // split the titles into shards, the last shard runs on this thread
+    size_t total = positions.size();
+    size_t shards = 1;
+    if (searchPool != nullptr && parallelSearchThreshold > 0 &&
+        total >= parallelSearchThreshold)
+      shards = searchPool->size() + 1;
+
+    size_t shardSize = (total + shards - 1) / shards;
+    vector<future<vector<Scored>>> futures;
+    for (size_t begin = 0; begin + shardSize < total; begin += shardSize)
+      futures.push_back(searchPool->submit(
+          [&, begin] { return scoreRange(begin, begin + shardSize); }));
+
+    vector<Scored> top = scoreRange(futures.size() * shardSize, total);
+    for (auto &future : futures) {
+      vector<Scored> shard = future.get();
+      top.insert(top.end(), shard.begin(), shard.end());
+    }
+
+    // merge the shards
+    sort(top.begin(), top.end(), isBetter);
+    if (top.size() > limit)
+      top.resize(limit);
+
+    return top;
+  }
+
+  // The largest UPDATE_TIME pulled by the last refresh.
+  int titlesWatermark = 0;
+
+  void updateCaches(bool fullReload) {
+    shared_ptr<const TitlesSnapshot> current = titlesSnapshot.load();
     session sql(*pool);
 
-    // update the cached titles
-    rowset<row> titlesRs = sql.prepare << "SELECT ID, TITLE FROM MANGA";
-    titles.clear();
-    titlesWithId.clear();
+    // only pull the rows updated since the last refresh, the rows at the
+    // watermark are pulled again as they may be written in the same second
+    int since = fullReload ? 0 : titlesWatermark;
+    rowset<row> titlesRs = (sql.prepare << "SELECT ID, TITLE, UPDATE_TIME FROM "
+                                           "MANGA WHERE UPDATE_TIME >= :since",
+                            use(since));
+
+    int latest = since;
+    shared_ptr<TitlesSnapshot> next;
+    if (fullReload)
+      next = make_shared<TitlesSnapshot>();
+
     for (auto it = titlesRs.begin(); it != titlesRs.end(); it++) {
       const row &row = *it;
-      titlesWithId[row.get<string>("TITLE")].push_back(row.get<string>("ID"));
-      titles.push_back(row.get<string>("TITLE"));
+      string id = row.get<string>("ID");
+      string title = row.get<string>("TITLE");
+      latest = max(latest, row.get<int>("UPDATE_TIME"));
+
+      const TitlesSnapshot &base = next == nullptr ? *current : *next;
+      auto found = base.titleOfId.find(id);
+      if (found != base.titleOfId.end() && found->second == title)
+        continue;
+
+      // copy the current snapshot only when something has changed
+      if (next == nullptr)
+        next = make_shared<TitlesSnapshot>(*current);
+
+      // remove the id from its previous title
+      auto previous = next->titleOfId.find(id);
+      if (previous != next->titleOfId.end()) {
+        vector<string> &ids = next->titlesWithId[previous->second];
+        ids.erase(remove(ids.begin(), ids.end(), id), ids.end());
+        if (ids.empty())
+          next->titlesWithId.erase(previous->second);
+      }
+
+      next->titleOfId[id] = title;
+      next->titlesWithId[title].push_back(id);
     }
+
+    titlesWatermark = latest;
+
+    if (next == nullptr)
+      return;
+
+    next->titles.clear();
+    next->titles.reserve(next->titlesWithId.size());
+    for (const auto &pair : next->titlesWithId)
+      next->titles.push_back(pair.first);
+
+    // rebuild the index alongside the titles
+    next->titlesIndex.build(next->titles);
+
+    titlesSnapshot.store(std::move(next));
   }
 
   void titlesCacheUpdateLoop() {
+    int counter = 0;
+
     while (true) {
-      if (isOnline)
-        updateCaches();
+      if (isOnline) {
+        try {
+          updateCaches(counter % TITLES_FULL_RELOAD_INTERVAL == 0);
+          counter++;
+        } catch (...) {
+          log(id, "Failed to Update the Titles Cache");
+        }
+      }
+
       this_thread::sleep_for(chrono::minutes(5));
     }
   }
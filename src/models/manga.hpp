@@ -80,6 +80,9 @@ public:
       : driver(driver), id(id), title(title), thumbnail(thumbnail),
         latest(latest), isEnded(isEnded) {}
 
+  // The copies are owned through Manga pointers, e.g. by the manga cache.
+  virtual ~Manga() = default;
+
   // Convert the manga object into json object
   virtual json toJson() {
     json result;
@@ -98,6 +101,15 @@ public:
   void useProxy(const string &baseUrl) {
     thumbnail = driver->useProxy(thumbnail, "thumbnail", baseUrl);
   }
+
+  // Return a new copy of the manga.
+  virtual Manga *clone() const { return new Manga(*this); }
+
+  // Return the approximate memory usage of the manga in bytes.
+  virtual size_t bytes() const {
+    return sizeof(Manga) + id.size() + title.size() + thumbnail.size() +
+           latest.size();
+  }
 };
 
 class DetailsManga : public Manga {
@@ -122,6 +134,12 @@ public:
         description(description), genres(genres), chapters(chapters),
         updateTime(updateTime) {}
 
+  DetailsManga(const DetailsManga &other)
+      : Manga(other), description(other.description), genres(other.genres),
+        chapters(other.chapters), authors(other.authors),
+        updateTime(other.updateTime == nullptr ? nullptr
+                                               : new int(*other.updateTime)) {}
+
   ~DetailsManga() {
     if (updateTime != nullptr)
       delete updateTime;
@@ -162,6 +180,23 @@ public:
     return result;
   }
 
+  Manga *clone() const override { return new DetailsManga(*this); }
+
+  size_t bytes() const override {
+    size_t result = Manga::bytes() - sizeof(Manga) + sizeof(DetailsManga) +
+                    description.size() + chapters.extraData.size() +
+                    genres.size() * sizeof(Genre);
+
+    for (const auto &author : authors)
+      result += sizeof(string) + author.size();
+
+    for (const auto *list : {&chapters.serial, &chapters.extra})
+      for (const auto &chapter : *list)
+        result += sizeof(Chapter) + chapter.title.size() + chapter.id.size();
+
+    return result;
+  }
+
   static DetailsManga *fromJson(const json &data) {
     vector<Genre> genres;
     for (string genre : data["genres"])
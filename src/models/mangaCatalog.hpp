@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// A row of the catalog.
+struct CatalogEntry {
+  string id;
+  string title;
+  string thumbnail;
+  string latest;
+  bool isEnded;
+  long long genreMask;
+  int updateTime;
+};
+
+// An in-memory copy of the MANGA table, kept as a struct of arrays.
+// The rows are stored in the order of the list, i.e. by UPDATE_TIME and ID
+// descending, so a page is a forward scan over the contiguous columns.
+class MangaCatalog {
+public:
+  // Replace all the rows of the catalog.
+  void load(vector<CatalogEntry> entries) {
+    sort(entries.begin(), entries.end(),
+         [](const CatalogEntry &a, const CatalogEntry &b) {
+           return isBefore(a.updateTime, a.id, b.updateTime, b.id);
+         });
+
+    unique_lock<shared_mutex> guard(mutex);
+    clear();
+    for (auto &entry : entries)
+      insertAt(size(), std::move(entry));
+  }
+
+  // Insert or replace the row with the same id.
+  void upsert(CatalogEntry entry) {
+    unique_lock<shared_mutex> guard(mutex);
+    eraseUnlocked(entry.id);
+
+    insertAt(lowerBound(entry.updateTime, entry.id), std::move(entry));
+  }
+
+  // Remove the row with the given id if it exists.
+  void erase(const string &id) {
+    unique_lock<shared_mutex> guard(mutex);
+    eraseUnlocked(id);
+  }
+
+  // Return the rows of a page in the list order.
+  // The rows must have at least one genre in genreMask unless it is 0, and
+  // their IS_ENDED must not be excludedEnded. Pass -1 to accept both.
+  // Only the rows after the given (UPDATE_TIME, ID) are returned if it is
+  // given, and the first offset matching rows are skipped.
+  vector<CatalogEntry> scan(long long genreMask, int excludedEnded,
+                            const optional<pair<int, string>> &after,
+                            size_t offset, size_t limit) const {
+    shared_lock<shared_mutex> guard(mutex);
+
+    size_t begin =
+        after.has_value() ? upperBound(after->first, after->second) : 0;
+    bool anyGenre = genreMask == 0;
+
+    vector<CatalogEntry> result;
+    // test the rows in blocks with a branchless loop, so the compiler can
+    // vectorise the filter
+    uint8_t matches[SCAN_BLOCK_SIZE];
+    for (size_t start = begin; start < size() && result.size() < limit;
+         start += SCAN_BLOCK_SIZE) {
+      size_t count = min<size_t>(SCAN_BLOCK_SIZE, size() - start);
+      const long long *masks = genreMasks.data() + start;
+      const uint8_t *ended = isEnded.data() + start;
+
+      for (size_t i = 0; i < count; i++)
+        matches[i] = (anyGenre | ((masks[i] & genreMask) != 0)) &
+                     (ended[i] != excludedEnded);
+
+      for (size_t i = 0; i < count && result.size() < limit; i++) {
+        if (!matches[i])
+          continue;
+
+        if (offset > 0) {
+          offset--;
+          continue;
+        }
+
+        result.push_back(entryAt(start + i));
+      }
+    }
+
+    return result;
+  }
+
+  size_t size() const { return ids.size(); }
+
+private:
+  static constexpr size_t SCAN_BLOCK_SIZE = 256;
+
+  mutable shared_mutex mutex;
+  vector<string> ids;
+  vector<string> titles;
+  vector<string> thumbnails;
+  vector<string> latest;
+  vector<uint8_t> isEnded;
+  vector<long long> genreMasks;
+  vector<int> updateTimes;
+  // The UPDATE_TIME of each id, used to find the row of an id.
+  unordered_map<string, int> updateTimeOfId;
+
+  // Whether the row a comes before the row b in the list order.
+  static bool isBefore(int aTime, const string &aId, int bTime,
+                       const string &bId) {
+    return aTime != bTime ? aTime > bTime : aId > bId;
+  }
+
+  // The first position not before the given row.
+  size_t lowerBound(int updateTime, const string &id) const {
+    size_t low = 0, high = size();
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      if (isBefore(updateTimes[mid], ids[mid], updateTime, id))
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    return low;
+  }
+
+  // The first position after the given row.
+  size_t upperBound(int updateTime, const string &id) const {
+    size_t position = lowerBound(updateTime, id);
+    if (position < size() && updateTimes[position] == updateTime &&
+        ids[position] == id)
+      position++;
+
+    return position;
+  }
+
+  CatalogEntry entryAt(size_t i) const {
+    return {ids[i],          titles[i],     thumbnails[i], latest[i],
+            isEnded[i] == 1, genreMasks[i], updateTimes[i]};
+  }
+
+  void insertAt(size_t i, CatalogEntry &&entry) {
+    updateTimeOfId[entry.id] = entry.updateTime;
+    ids.insert(ids.begin() + i, std::move(entry.id));
+    titles.insert(titles.begin() + i, std::move(entry.title));
+    thumbnails.insert(thumbnails.begin() + i, std::move(entry.thumbnail));
+    latest.insert(latest.begin() + i, std::move(entry.latest));
+    isEnded.insert(isEnded.begin() + i, entry.isEnded);
+    genreMasks.insert(genreMasks.begin() + i, entry.genreMask);
+    updateTimes.insert(updateTimes.begin() + i, entry.updateTime);
+  }
+
+  void eraseUnlocked(const string &id) {
+    auto it = updateTimeOfId.find(id);
+    if (it == updateTimeOfId.end())
+      return;
+
+    size_t i = lowerBound(it->second, id);
+    updateTimeOfId.erase(it);
+
+    ids.erase(ids.begin() + i);
+    titles.erase(titles.begin() + i);
+    thumbnails.erase(thumbnails.begin() + i);
+    latest.erase(latest.begin() + i);
+    isEnded.erase(isEnded.begin() + i);
+    genreMasks.erase(genreMasks.begin() + i);
+    updateTimes.erase(updateTimes.begin() + i);
+  }
+
+  void clear() {
+    ids.clear();
+    titles.clear();
+    thumbnails.clear();
+    latest.clear();
+    isEnded.clear();
+    genreMasks.clear();
+    updateTimes.clear();
+    updateTimeOfId.clear();
+  }
+};
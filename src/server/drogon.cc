@@ -1,5 +1,6 @@
 #include "drogon.hpp"
 
+#include "../drivers/activeAdapter/activeAdapter.hpp"
 #include "../drivers/selfContained/selfContained.hpp"
 #include "../manager/accessGuard.hpp"
 #include "../manager/driversManager.hpp"
@@ -8,6 +9,7 @@
 #include "../utils/converter.hpp"
 #include "../utils/log.hpp"
 #include "../utils/mimeTypes.h"
+#include "../utils/singleFlight.hpp"
 #include "../utils/utils.hpp"
 
 #include <drogon/drogon.h>
@@ -67,6 +69,19 @@
     }                                                                          \
   }
 
+#define GET_CURSOR()                                                           \
+  string cursor = req->getParameter("cursor");                                 \
+  string nextCursor;                                                           \
+  LocalDriver *localDriver = dynamic_cast<LocalDriver *>(driver);
+
+#define JSON_RESPONSE_WITH_CURSOR(str)                                         \
+  HttpResponsePtr resp = HttpResponse::newHttpResponse();                      \
+  resp->setContentTypeCode(CT_APPLICATION_JSON);                               \
+  if (!nextCursor.empty())                                                     \
+    resp->addHeader("X-Next-Cursor", nextCursor);                              \
+  resp->setBody(str);                                                          \
+  return callback(resp);
+
 #define GET_KEYWORD()                                                          \
   string keyword = req->getParameter("keyword");                               \
   if (keyword == "") {                                                         \
@@ -79,10 +94,19 @@
         R"({"error":"AccessGuard is not set to "token" mode."})")              \
   }
 
+#define GET_ACTIVE_ADAPTER()                                                   \
+  ActiveAdapter *adapter = dynamic_cast<ActiveAdapter *>(                      \
+      driversManager.get(req->getParameter("driver")));                        \
+  if (adapter == nullptr) {                                                    \
+    JSON_404_RESPONSE(R"({"error":"Active driver is not found."})")            \
+  }
+
 namespace drogonServer {
 string *webpageUrl;
 string serverVersion;
 Converter converter;
+// The concurrent requests of the same chapter share one driver call.
+SingleFlight<vector<string>> chapterFlights;
 } // namespace drogonServer
 
 using namespace drogonServer;
@@ -164,6 +188,67 @@ auto getDriverOnline = [](const HttpRequestPtr &req,
   JSON_RESPONSE(result.dump())
 };
 
+auto getStats = [](const HttpRequestPtr &req,
+                   function<void(const HttpResponsePtr &)> &&callback) {
+  vector<BaseDriver *> drivers;
+
+  string driverIds = req->getParameter("drivers");
+  if (driverIds != "") {
+    BaseDriver *temp;
+    for (const auto &id : split(driverIds, ",")) {
+      temp = driversManager.get(id);
+      if (temp != nullptr)
+        drivers.push_back(temp);
+    }
+  } else {
+    drivers = driversManager.getAll();
+  }
+
+  json result = json::object();
+  for (BaseDriver *driver : drivers)
+    result[driver->id] = driver->getStats();
+
+  if (driverIds == "")
+    result["images"] = imagesManager.getStats();
+
+  JSON_RESPONSE(result.dump())
+};
+
+auto getBackfill = [](const HttpRequestPtr &req,
+                      function<void(const HttpResponsePtr &)> &&callback) {
+  GET_ACTIVE_ADAPTER()
+
+  JSON_RESPONSE(adapter->getBackfill().dump())
+};
+
+auto startBackfill = [](const HttpRequestPtr &req,
+                        function<void(const HttpResponsePtr &)> &&callback) {
+  GET_ACTIVE_ADAPTER()
+
+  try {
+    adapter->startBackfill(req->getParameter("restart") == "1");
+
+    JSON_RESPONSE(adapter->getBackfill().dump())
+  } catch (...) {
+    JSON_400_RESPONSE(
+        R"({"error": "An unexpected error occurred when trying to start backfill."})")
+  }
+};
+
+auto stopBackfill = [](const HttpRequestPtr &req,
+                       function<void(const HttpResponsePtr &)> &&callback) {
+  GET_ACTIVE_ADAPTER()
+
+  try {
+    adapter->stopBackfill();
+
+    JSON_RESPONSE(adapter->getBackfill().dump())
+  } catch (...) {
+    JSON_400_RESPONSE(
+        R"({"error": "An unexpected error occurred when trying to stop backfill."})")
+  }
+};
+
 auto getList = [](const HttpRequestPtr &req,
                   function<void(const HttpResponsePtr &)> &&callback) {
   GET_DRIVER()
@@ -188,8 +273,14 @@ auto getList = [](const HttpRequestPtr &req,
     }
   }
 
+  GET_CURSOR()
+
   try {
-    vector<Manga *> mangas = driver->getList(genre, page, status);
+    // local drivers support the cursor, the others only support the page
+    vector<Manga *> mangas =
+        localDriver != nullptr
+            ? localDriver->getList(genre, status, cursor, nextCursor, page)
+            : driver->getList(genre, page, status);
     json result = json::array();
     for (Manga *manga : mangas) {
       if (proxy)
@@ -200,7 +291,7 @@ auto getList = [](const HttpRequestPtr &req,
 
     releaseMemory(mangas);
 
-    JSON_RESPONSE(result.dump())
+    JSON_RESPONSE_WITH_CURSOR(result.dump())
   } catch (...) {
     JSON_400_RESPONSE(
         R"({"error": "An unexpected error occurred when trying to get list."})")
@@ -277,7 +368,9 @@ auto getChapter = [](const HttpRequestPtr &req,
   string extraData = req->getParameter("extra-data");
 
   try {
-    vector<string> urls = driver->getChapter(id, extraData);
+    vector<string> urls = chapterFlights.run(
+        fmt::format("{}\u001D{}\u001D{}", driver->id, id, extraData),
+        [&] { return driver->getChapter(id, extraData); });
     json result = json::array();
     if (proxy)
       for (const string &url : urls)
@@ -318,8 +411,13 @@ auto getSearch = [](const HttpRequestPtr &req,
 
   GET_PROXY()
 
+  GET_CURSOR()
+
   try {
-    vector<Manga *> mangas = driver->search(keyword, page);
+    vector<Manga *> mangas =
+        localDriver != nullptr
+            ? localDriver->search(keyword, cursor, nextCursor, page)
+            : driver->search(keyword, page);
     json result = json::array();
     for (Manga *manga : mangas) {
       if (proxy)
@@ -330,7 +428,7 @@ auto getSearch = [](const HttpRequestPtr &req,
 
     releaseMemory(mangas);
 
-    JSON_RESPONSE(result.dump())
+    JSON_RESPONSE_WITH_CURSOR(result.dump())
   } catch (...) {
     JSON_400_RESPONSE(
         R"({"error": "An unexpected error occurred when trying to search manga."})")
@@ -388,18 +486,54 @@ auto getImage = [](const HttpRequestPtr &req,
     if (tryBase64 != "")
       useBase64 = std::stoi(tryBase64) == 1;
 
-    vector<string> result = imagesManager.getImage(id, genre, hash, useBase64);
+    string cacheControl = req->getHeader("Cache-Control");
+    if (cacheControl.empty())
+      cacheControl = "max-age=43200";
+
+    // send the cached image straight from the file
+    string path;
+    long long modifiedTime;
+    if (!useBase64 &&
+        imagesManager.getCachedImage(id, genre, hash, path, modifiedTime)) {
+      string lastModified =
+          utils::getHttpFullDate(trantor::Date(modifiedTime * 1000000));
+
+      if (req->getHeader("If-Modified-Since") == lastModified) {
+        HttpResponsePtr resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k304NotModified);
+        resp->addHeader("Last-Modified", lastModified);
+        resp->addHeader("Cache-Control", cacheControl);
+
+        return callback(resp);
+      }
 
-    HttpResponsePtr resp = HttpResponse::newHttpResponse();
-    resp->setContentTypeString(mime_types.at(result[0]));
-    resp->setBody(result[1]);
+      HttpResponsePtr resp = HttpResponse::newFileResponse(
+          path, "", CT_CUSTOM, mime_types.at("webp"));
 
-    string cacheControl = req->getHeader("Cache-Control");
+      // the file may have just been evicted
+      if (resp->statusCode() == k200OK) {
+        resp->addHeader("Last-Modified", lastModified);
+        resp->addHeader("Cache-Control", cacheControl);
 
-    resp->addHeader("Cache-Control",
-                    cacheControl.empty() ? "max-age=43200" : cacheControl);
+        return callback(resp);
+      }
+    }
 
-    return callback(resp);
+    // fetch and convert the image off the event loop, the loop keeps serving
+    // the other requests meanwhile
+    imagesManager.getImageAsync(
+        id, genre, hash, useBase64,
+        [callback, cacheControl](vector<string> result) {
+          if (result.empty())
+            return callback(HttpResponse::newNotFoundResponse());
+
+          HttpResponsePtr resp = HttpResponse::newHttpResponse();
+          resp->setContentTypeString(mime_types.at(result[0]));
+          resp->setBody(std::move(result[1]));
+          resp->addHeader("Cache-Control", cacheControl);
+
+          callback(resp);
+        });
   } catch (...) {
     return callback(HttpResponse::newNotFoundResponse());
   }
@@ -855,6 +989,7 @@ void startDrogonServer(int port, string *_webpageUrl) {
       [](const HttpRequestPtr &req, const HttpResponsePtr &resp) {
         resp->addHeader("Access-Control-Allow-Origin", "*");
         resp->addHeader("Access-Control-Allow-Headers", "*");
+        resp->addHeader("Access-Control-Expose-Headers", "X-Next-Cursor");
 
         stringstream ss;
         ss << req;
@@ -948,6 +1083,14 @@ void startDrogonServer(int port, string *_webpageUrl) {
   app().registerHandler("/admin/chapter/upload", uploadChapter,
                         {Post, Options});
 
+  // Runtime statistics
+  app().registerHandler("/admin/stats", getStats, {Get, Options});
+
+  // Backfill of active drivers
+  app().registerHandler("/admin/backfill", getBackfill, {Get, Options});
+  app().registerHandler("/admin/backfill", startBackfill, {Post, Options});
+  app().registerHandler("/admin/backfill", stopBackfill, {Delete, Options});
+
   log("Drogon", fmt::format("Listening on Port {}", port));
   app()
       .setClientMaxBodySize(1024 * 1024 * 1024)
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "base64.hpp"
+
+#include <nlohmann/json.hpp>
+#include <string>
+
+using json = nlohmann::json;
+using namespace std;
+
+// Encode the position of a page into an opaque and url-safe cursor.
+static string encodeCursor(const json &position) {
+  string cursor = base64::to_base64(position.dump());
+
+  // use the url-safe alphabet and drop the padding
+  replace(cursor.begin(), cursor.end(), '+', '-');
+  replace(cursor.begin(), cursor.end(), '/', '_');
+  cursor.erase(cursor.find_last_not_of('=') + 1);
+
+  return cursor;
+}
+
+// Decode the cursor back into the position of the page.
+// Throw if the cursor is malformed.
+static json decodeCursor(string cursor) {
+  replace(cursor.begin(), cursor.end(), '-', '+');
+  replace(cursor.begin(), cursor.end(), '_', '/');
+  cursor.append((4 - cursor.size() % 4) % 4, '=');
+
+  return json::parse(base64::from_base64(cursor));
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+using namespace std;
+
+// The number of entries evicted before the evictor yields.
+#define IMAGE_CACHE_EVICTION_BATCH 64
+
+// A thread-safe index of the cached images, bounded by their total size in
+// bytes.
+// The entries are grouped, usually by driver, and each group may be bounded by
+// its own quota. The least recently used entries are evicted by a background
+// thread a batch at a time, so the cache stays warm instead of being wiped.
+class ImageCache {
+public:
+  // onEvict is called with the key of every evicted entry, without the lock.
+  ImageCache(function<void(const string &)> onEvict) : onEvict(onEvict) {}
+
+  // Set the capacity in bytes. Set it to 0 to remove the limit.
+  void setCapacity(unsigned long long bytes) {
+    lock_guard<std::mutex> guard(mutex);
+    capacity = bytes;
+    wake.notify_one();
+  }
+
+  // Set the quota of the group in bytes. Set it to 0 to remove the limit.
+  void setQuota(const string &group, unsigned long long bytes) {
+    lock_guard<std::mutex> guard(mutex);
+    groups[group].quota = bytes;
+    wake.notify_one();
+  }
+
+  // Insert or replace the entry as the most recently used.
+  void add(const string &key, const string &group, unsigned long long bytes) {
+    lock_guard<std::mutex> guard(mutex);
+
+    auto it = index.find(key);
+    if (it != index.end())
+      remove(it);
+
+    Group &target = groups[group];
+    target.entries.push_front({key, group, bytes, ++clock});
+    target.bytes += bytes;
+    totalBytes += bytes;
+    index[key] = target.entries.begin();
+
+    if (isOver())
+      wake.notify_one();
+  }
+
+  // Mark the entry as the most recently used. Return false if it is not
+  // cached.
+  bool touch(const string &key) {
+    lock_guard<std::mutex> guard(mutex);
+
+    auto it = index.find(key);
+    if (it == index.end())
+      return false;
+
+    Group &group = groups[it->second->group];
+    it->second->used = ++clock;
+    group.entries.splice(group.entries.begin(), group.entries, it->second);
+
+    return true;
+  }
+
+  // Remove the entry without calling onEvict.
+  void erase(const string &key) {
+    lock_guard<std::mutex> guard(mutex);
+
+    auto it = index.find(key);
+    if (it != index.end())
+      remove(it);
+  }
+
+  // Start the background eviction.
+  void start() {
+    thread(&ImageCache::evictLoop, this).detach();
+  }
+
+  json getStats() {
+    lock_guard<std::mutex> guard(mutex);
+
+    json stats = {{"entries", index.size()},
+                  {"bytes", totalBytes},
+                  {"capacity", capacity},
+                  {"evictions", evictions}};
+
+    json groupStats = json::object();
+    for (const auto &pair : groups)
+      groupStats[pair.first] = {{"entries", pair.second.entries.size()},
+                                {"bytes", pair.second.bytes},
+                                {"quota", pair.second.quota}};
+    stats["groups"] = groupStats;
+
+    return stats;
+  }
+
+private:
+  struct Entry {
+    string key;
+    string group;
+    unsigned long long bytes;
+    // The value of the clock when it was last used.
+    unsigned long long used;
+  };
+
+  struct Group {
+    // The most recently used first.
+    list<Entry> entries;
+    unsigned long long bytes = 0;
+    unsigned long long quota = 0;
+  };
+
+  std::mutex mutex;
+  condition_variable wake;
+  function<void(const string &)> onEvict;
+  unordered_map<string, list<Entry>::iterator> index;
+  map<string, Group> groups;
+  unsigned long long capacity = 0;
+  unsigned long long totalBytes = 0;
+  unsigned long long clock = 0;
+  unsigned long long evictions = 0;
+
+  void remove(unordered_map<string, list<Entry>::iterator>::iterator it) {
+    Group &group = groups[it->second->group];
+    group.bytes -= it->second->bytes;
+    totalBytes -= it->second->bytes;
+    group.entries.erase(it->second);
+    index.erase(it);
+  }
+
+  bool isOver() {
+    if (capacity > 0 && totalBytes > capacity)
+      return true;
+
+    for (const auto &pair : groups)
+      if (pair.second.quota > 0 && pair.second.bytes > pair.second.quota)
+        return true;
+
+    return false;
+  }
+
+  // Pick the least recently used entry of a group over its quota, or of all
+  // the groups if the cache is over its capacity. Return nullptr if there is
+  // nothing to evict.
+  Entry *victim() {
+    Entry *result = nullptr;
+    for (auto &pair : groups) {
+      Group &group = pair.second;
+      if (group.entries.empty())
+        continue;
+
+      if (group.quota > 0 && group.bytes > group.quota)
+        return &group.entries.back();
+
+      if (result == nullptr || group.entries.back().used < result->used)
+        result = &group.entries.back();
+    }
+
+    return capacity > 0 && totalBytes > capacity ? result : nullptr;
+  }
+
+  void evictLoop() {
+    while (true) {
+      vector<string> keys;
+
+      unique_lock<std::mutex> guard(mutex);
+      wake.wait(guard, [this] { return isOver(); });
+
+      // evict a batch at a time so the requests are not blocked for long
+      while (keys.size() < IMAGE_CACHE_EVICTION_BATCH) {
+        Entry *entry = victim();
+        if (entry == nullptr)
+          break;
+
+        keys.push_back(entry->key);
+        remove(index.find(entry->key));
+        evictions++;
+      }
+      guard.unlock();
+
+      for (const auto &key : keys)
+        onEvict(key);
+
+      this_thread::sleep_for(chrono::milliseconds(10));
+    }
+  }
+};
@@ -2,6 +2,8 @@
 
 #include <fmt/chrono.h>
 #include <fmt/color.h>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// A thread-safe least recently used cache bounded by the total size of its
+// values in bytes.
+// The keys are spread over several shards, each guarded by its own mutex and
+// holding an equal share of the capacity.
+template <typename V> class LruCache {
+public:
+  LruCache(size_t capacity, size_t shardCount = 16)
+      : shards(max<size_t>(shardCount, 1)), capacity(capacity) {}
+
+  // Set the capacity in bytes. Set it to 0 to disable the cache.
+  void setCapacity(size_t bytes) {
+    capacity = bytes;
+
+    for (auto &shard : shards) {
+      lock_guard<std::mutex> guard(shard.mutex);
+      evict(shard);
+    }
+  }
+
+  // Return the value and mark it as the most recently used.
+  optional<V> get(const string &key) {
+    Shard &shard = shardOf(key);
+    lock_guard<std::mutex> guard(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      missCount++;
+      return nullopt;
+    }
+
+    hitCount++;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    return it->second->value;
+  }
+
+  // Insert or replace the value, evicting the least recently used values if
+  // the shard is full.
+  // If isCurrent is given, the value is only inserted if it returns true. It
+  // is called under the lock of the shard, so an erase of the key made after
+  // the value turns stale is never overtaken by the insert.
+  void put(const string &key, V value, size_t bytes,
+           const function<bool()> &isCurrent = nullptr) {
+    // the value would evict everything in the shard, don't cache it
+    bytes += key.size();
+    if (bytes > shardCapacity())
+      return erase(key);
+
+    Shard &shard = shardOf(key);
+    lock_guard<std::mutex> guard(shard.mutex);
+
+    if (isCurrent != nullptr && !isCurrent())
+      return;
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+      remove(shard, it->second);
+
+    shard.entries.push_front({key, std::move(value), bytes});
+    shard.index[key] = shard.entries.begin();
+    shard.bytes += bytes;
+    totalBytes += bytes;
+    totalEntries++;
+
+    evict(shard);
+  }
+
+  // Remove the value if it exists.
+  void erase(const string &key) {
+    Shard &shard = shardOf(key);
+    lock_guard<std::mutex> guard(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+      remove(shard, it->second);
+  }
+
+  unsigned long long hits() const { return hitCount; }
+
+  unsigned long long misses() const { return missCount; }
+
+  // The total size of the cached values in bytes.
+  size_t bytes() const { return totalBytes; }
+
+  // The number of cached values.
+  size_t size() const { return totalEntries; }
+
+  size_t getCapacity() const { return capacity; }
+
+private:
+  struct Entry {
+    string key;
+    V value;
+    size_t bytes;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    // The most recently used entry is at the front.
+    list<Entry> entries;
+    unordered_map<string, typename list<Entry>::iterator> index;
+    size_t bytes = 0;
+  };
+
+  vector<Shard> shards;
+  atomic<size_t> capacity;
+  atomic<size_t> totalBytes = 0;
+  atomic<size_t> totalEntries = 0;
+  atomic<unsigned long long> hitCount = 0;
+  atomic<unsigned long long> missCount = 0;
+
+  size_t shardCapacity() const { return capacity / shards.size(); }
+
+  Shard &shardOf(const string &key) {
+    return shards[hash<string>{}(key) % shards.size()];
+  }
+
+  void remove(Shard &shard, typename list<Entry>::iterator it) {
+    shard.bytes -= it->bytes;
+    totalBytes -= it->bytes;
+    totalEntries--;
+
+    shard.index.erase(it->key);
+    shard.entries.erase(it);
+  }
+
+  void evict(Shard &shard) {
+    while (shard.bytes > shardCapacity() && !shard.entries.empty())
+      remove(shard, prev(shard.entries.end()));
+  }
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "tokenBucket.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using json = nlohmann::json;
+using namespace std;
+
+// The weight of the latest request in the averages.
+#define PROXY_POOL_ALPHA 0.2
+// The number of consecutive failures before a proxy is cooled down.
+#define PROXY_POOL_FAILURE_THRESHOLD 3
+// The first cool-down in seconds, it doubles on every further failure.
+#define PROXY_POOL_COOLDOWN 30
+// The longest cool-down in seconds.
+#define PROXY_POOL_MAX_COOLDOWN 600
+
+// A pool of proxies that tracks the health of each proxy.
+// The proxies are picked at random, weighted by their latency, error rate, and
+// load. A proxy failing repeatedly is skipped until its cool-down ends.
+// Each proxy also has its own rate budget for the requests that must respect
+// the upstream limit. An empty string stands for the direct connection.
+class ProxyPool {
+public:
+  // Add the proxy with its rate budget in requests per second. The proxies
+  // already in the pool are ignored.
+  void add(const string &proxy, double ratePerSecond) {
+    lock_guard<std::mutex> guard(mutex);
+
+    for (const auto &entry : entries)
+      if (entry->proxy == proxy)
+        return;
+
+    entries.push_back(make_unique<Entry>());
+    entries.back()->proxy = proxy;
+    entries.back()->bucket = make_unique<TokenBucket>(ratePerSecond);
+  }
+
+  // Pick a proxy without waiting for its rate budget.
+  string select() {
+    lock_guard<std::mutex> guard(mutex);
+    if (entries.empty())
+      return "";
+
+    return pick(candidates())->proxy;
+  }
+
+  // Pick a proxy with some rate budget left and take a token from it, waiting
+  // until one is available.
+  string acquire() {
+    while (true) {
+      unique_lock<std::mutex> guard(mutex);
+      if (entries.empty())
+        return "";
+
+      // try the proxies in a weighted random order
+      vector<Entry *> remaining = candidates();
+      while (!remaining.empty()) {
+        Entry *entry = pick(remaining);
+        if (entry->bucket->tryAcquire())
+          return entry->proxy;
+
+        remaining.erase(find(remaining.begin(), remaining.end(), entry));
+      }
+      guard.unlock();
+
+      this_thread::sleep_for(chrono::milliseconds(100));
+    }
+  }
+
+  // Run the request through the proxy and record its latency and result.
+  // The exception of the request is rethrown.
+  template <typename F>
+  invoke_result_t<F> track(const string &proxy, F &&request) {
+    Entry *entry = entryOf(proxy);
+    if (entry != nullptr) {
+      lock_guard<std::mutex> guard(mutex);
+      entry->inFlight++;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    try {
+      if constexpr (is_void_v<invoke_result_t<F>>) {
+        request();
+        report(entry, start, true);
+      } else {
+        invoke_result_t<F> result = request();
+        report(entry, start, true);
+        return result;
+      }
+    } catch (...) {
+      report(entry, start, false);
+      throw;
+    }
+  }
+
+  json getStats() {
+    lock_guard<std::mutex> guard(mutex);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    json stats = json::object();
+    for (const auto &entry : entries) {
+      double cooldown = 0;
+      if (entry->cooldownUntil > now)
+        cooldown = chrono::duration<double>(entry->cooldownUntil - now).count();
+
+      stats[entry->proxy.empty() ? "direct" : entry->proxy] = {
+          {"requests", entry->requests},
+          {"failures", entry->failures},
+          {"latency", entry->latency},
+          {"errorRate", entry->errorRate},
+          {"inFlight", entry->inFlight},
+          {"cooldown", cooldown}};
+    }
+
+    return stats;
+  }
+
+private:
+  struct Entry {
+    string proxy;
+    unique_ptr<TokenBucket> bucket;
+    // The average latency in milliseconds.
+    double latency = 0;
+    // The average of the failures, between 0 and 1.
+    double errorRate = 0;
+    int consecutiveFailures = 0;
+    int inFlight = 0;
+    unsigned long long requests = 0;
+    unsigned long long failures = 0;
+    chrono::steady_clock::time_point cooldownUntil;
+  };
+
+  std::mutex mutex;
+  // The entries are never removed, so their pointers stay valid.
+  vector<unique_ptr<Entry>> entries;
+  mt19937 random{random_device{}()};
+
+  Entry *entryOf(const string &proxy) {
+    lock_guard<std::mutex> guard(mutex);
+    for (const auto &entry : entries)
+      if (entry->proxy == proxy)
+        return entry.get();
+
+    return nullptr;
+  }
+
+  // The proxies not cooling down. If every proxy is cooling down, the one
+  // that recovers first is returned.
+  vector<Entry *> candidates() {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    vector<Entry *> result;
+    Entry *earliest = entries.front().get();
+    for (const auto &entry : entries) {
+      if (entry->cooldownUntil <= now)
+        result.push_back(entry.get());
+      if (entry->cooldownUntil < earliest->cooldownUntil)
+        earliest = entry.get();
+    }
+
+    if (result.empty())
+      result.push_back(earliest);
+
+    return result;
+  }
+
+  // Pick one of the entries at random, weighted by their health.
+  Entry *pick(const vector<Entry *> &options) {
+    vector<double> weights;
+    for (const auto *entry : options)
+      // an unused proxy is assumed to be as fast as 100ms, and a failing
+      // proxy keeps a small chance so it can recover
+      weights.push_back(max(pow(1 - entry->errorRate, 2), 0.01) /
+                        (max(entry->latency, 100.0) * (entry->inFlight + 1)));
+
+    return options[discrete_distribution<size_t>(weights.begin(),
+                                                 weights.end())(random)];
+  }
+
+  void report(Entry *entry, chrono::steady_clock::time_point start,
+              bool succeeded) {
+    if (entry == nullptr)
+      return;
+
+    double elapsed = chrono::duration<double, milli>(
+                         chrono::steady_clock::now() - start)
+                         .count();
+
+    lock_guard<std::mutex> guard(mutex);
+    entry->inFlight--;
+    entry->requests++;
+    entry->latency = entry->requests == 1
+                         ? elapsed
+                         : PROXY_POOL_ALPHA * elapsed +
+                               (1 - PROXY_POOL_ALPHA) * entry->latency;
+    entry->errorRate = PROXY_POOL_ALPHA * !succeeded +
+                       (1 - PROXY_POOL_ALPHA) * entry->errorRate;
+
+    if (succeeded) {
+      entry->consecutiveFailures = 0;
+      return;
+    }
+
+    entry->failures++;
+    entry->consecutiveFailures++;
+    int excess = entry->consecutiveFailures - PROXY_POOL_FAILURE_THRESHOLD;
+    if (excess >= 0)
+      entry->cooldownUntil =
+          chrono::steady_clock::now() +
+          chrono::seconds(min<long long>(PROXY_POOL_MAX_COOLDOWN,
+                                         (long long)PROXY_POOL_COOLDOWN
+                                             << min(excess, 16)));
+  }
+};
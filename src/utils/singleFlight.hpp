@@ -0,0 +1,49 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+// This class coalesces the concurrent calls with the same key, so that only
+// one of them runs and the others wait for its result or exception.
+template <typename T> class SingleFlight {
+public:
+  // Run the call, or wait for the running call with the same key.
+  T run(const string &key, const function<T()> &call) {
+    unique_lock<std::mutex> guard(mutex);
+
+    auto it = calls.find(key);
+    if (it != calls.end()) {
+      shared_future<T> result = it->second;
+      guard.unlock();
+
+      return result.get();
+    }
+
+    promise<T> pending;
+    shared_future<T> result = pending.get_future().share();
+    calls[key] = result;
+    guard.unlock();
+
+    try {
+      pending.set_value(call());
+    } catch (...) {
+      pending.set_exception(current_exception());
+    }
+
+    guard.lock();
+    calls.erase(key);
+    guard.unlock();
+
+    return result.get();
+  }
+
+private:
+  std::mutex mutex;
+  unordered_map<string, shared_future<T>> calls;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <soci/soci.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+using namespace std;
+using namespace soci;
+
+// The pragmas applied to every sqlite session of a connection pool.
+struct SqliteProfile {
+  // Readers don't block the writer and vice versa in the WAL mode.
+  string journalMode = "WAL";
+  // NORMAL is safe in the WAL mode, the last transactions may be rolled back
+  // after a power loss.
+  string synchronous = "NORMAL";
+  // In bytes.
+  long long mmapSize = 256LL * 1024 * 1024;
+  // In pages if positive, in KiB if negative.
+  int cacheSize = -16000;
+  // How long to wait for a lock before failing with SQLITE_BUSY in
+  // milliseconds.
+  int busyTimeout = 5000;
+  string tempStore = "MEMORY";
+  // The interval between the checkpoints and optimizations in minutes.
+  // Set it to 0 to disable the maintenance.
+  int maintenanceInterval = 10;
+
+  static SqliteProfile fromJson(const json &config) {
+    SqliteProfile profile;
+
+    auto getOption = [&](const string &key, string &value,
+                         const vector<string> &options) {
+      if (!config.contains(key))
+        return;
+
+      string option = config[key].get<string>();
+      transform(option.begin(), option.end(), option.begin(), ::toupper);
+      // name the option, nothing catches it before the server aborts
+      if (find(options.begin(), options.end(), option) == options.end())
+        throw invalid_argument(
+            fmt::format("Invalid sqlite.{}: \"{}\", expected one of {}", key,
+                        config[key].get<string>(), fmt::join(options, ", ")));
+
+      value = option;
+    };
+
+    getOption("journalMode", profile.journalMode,
+              {"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"});
+    getOption("synchronous", profile.synchronous,
+              {"OFF", "NORMAL", "FULL", "EXTRA"});
+    getOption("tempStore", profile.tempStore, {"DEFAULT", "FILE", "MEMORY"});
+
+    if (config.contains("mmapSize"))
+      profile.mmapSize = config["mmapSize"].get<long long>();
+
+    if (config.contains("cacheSize"))
+      profile.cacheSize = config["cacheSize"].get<int>();
+
+    if (config.contains("busyTimeout"))
+      profile.busyTimeout = config["busyTimeout"].get<int>();
+
+    if (config.contains("maintenanceInterval"))
+      profile.maintenanceInterval = config["maintenanceInterval"].get<int>();
+
+    return profile;
+  }
+
+  // Apply the pragmas to the session. This should be called right after the
+  // session is opened.
+  void apply(session &sql) const {
+    // set the timeout first, switching the journal mode needs a lock
+    sql << fmt::format("PRAGMA busy_timeout = {}", busyTimeout);
+    sql << fmt::format("PRAGMA journal_mode = {}", journalMode);
+    sql << fmt::format("PRAGMA synchronous = {}", synchronous);
+    sql << fmt::format("PRAGMA mmap_size = {}", mmapSize);
+    sql << fmt::format("PRAGMA cache_size = {}", cacheSize);
+    sql << fmt::format("PRAGMA temp_store = {}", tempStore);
+  }
+
+  // Start a thread that checkpoints the WAL and optimizes the database
+  // periodically.
+  void startMaintenance(connection_pool *pool, const string &name) const {
+    if (maintenanceInterval <= 0)
+      return;
+
+    thread([pool, name, interval = maintenanceInterval] {
+      while (true) {
+        this_thread::sleep_for(chrono::minutes(interval));
+
+        try {
+          session sql(*pool);
+          // PASSIVE never waits for the readers or the writer
+          sql << "PRAGMA wal_checkpoint(PASSIVE)";
+          sql << "PRAGMA optimize";
+        } catch (...) {
+          log(name, "Failed to Maintain the Database");
+        }
+      }
+    }).detach();
+  }
+};
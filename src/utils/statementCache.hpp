@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <soci/soci.h>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace std;
+using namespace soci;
+
+// A parameter bound to a cached statement.
+using StatementParam = variant<string, long long>;
+
+// This class caches the prepared statements of each session in a connection
+// pool, keyed by the SQL text and the types of the parameters.
+// The session is leased for the whole call, so the cached statements of a
+// session are never used by two threads at the same time.
+class StatementCache {
+public:
+  // Run the query and call onRow for every returned row.
+  void query(connection_pool &pool, const string &sql,
+             const vector<StatementParam> &params,
+             const function<void(const row &)> &onRow) {
+    Lease lease(pool);
+    Entry &entry = get(pool, lease.position, sql, params, true);
+
+    try {
+      entry.st->execute(false);
+      while (entry.st->fetch())
+        onRow(entry.r);
+    } catch (...) {
+      // the statement may be left in a bad state
+      drop(pool, lease.position, sql, params);
+      throw;
+    }
+  }
+
+  // Execute the statement and return the number of affected rows.
+  long long execute(connection_pool &pool, const string &sql,
+                    const vector<StatementParam> &params) {
+    Lease lease(pool);
+    Entry &entry = get(pool, lease.position, sql, params, false);
+
+    try {
+      entry.st->execute(true);
+      return entry.st->get_affected_rows();
+    } catch (...) {
+      drop(pool, lease.position, sql, params);
+      throw;
+    }
+  }
+
+  // The number of calls that reused a prepared statement.
+  unsigned long long hits() const { return hitCount; }
+
+  // The number of calls that had to prepare a new statement.
+  unsigned long long misses() const { return missCount; }
+
+private:
+  struct Entry {
+    // The bound values, the statement holds references to them.
+    vector<StatementParam> params;
+    row r;
+    unique_ptr<statement> st;
+  };
+
+  // Lease a session from the pool and give it back when destroyed.
+  struct Lease {
+    connection_pool &pool;
+    size_t position;
+
+    Lease(connection_pool &pool) : pool(pool), position(pool.lease()) {}
+    ~Lease() { pool.give_back(position); }
+  };
+
+  std::mutex mutex;
+  map<pair<connection_pool *, size_t>, map<string, unique_ptr<Entry>>>
+      sessions;
+  atomic<unsigned long long> hitCount = 0;
+  atomic<unsigned long long> missCount = 0;
+
+  // The key of a statement is the SQL text followed by the parameter types.
+  static string keyOf(const string &sql, const vector<StatementParam> &params) {
+    string key = sql;
+    key.push_back('\u001D');
+    for (const auto &param : params)
+      key.push_back('0' + param.index());
+
+    return key;
+  }
+
+  map<string, unique_ptr<Entry>> &entriesOf(connection_pool &pool,
+                                            size_t position) {
+    // the inner map is only touched by the thread holding the session
+    lock_guard<std::mutex> guard(mutex);
+    return sessions[{&pool, position}];
+  }
+
+  Entry &get(connection_pool &pool, size_t position, const string &sql,
+             const vector<StatementParam> &params, bool hasRows) {
+    map<string, unique_ptr<Entry>> &entries = entriesOf(pool, position);
+    string key = keyOf(sql, params);
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      hitCount++;
+
+      // the types are part of the key, so the bound references stay valid
+      Entry &entry = *it->second;
+      for (size_t i = 0; i < params.size(); i++)
+        entry.params[i] = params[i];
+
+      return entry;
+    }
+
+    missCount++;
+
+    unique_ptr<Entry> entry = make_unique<Entry>();
+    entry->params = params;
+    entry->st = make_unique<statement>(pool.at(position));
+
+    statement &st = *entry->st;
+    st.alloc();
+    st.prepare(sql);
+    for (auto &param : entry->params)
+      visit([&](auto &value) { st.exchange(use(value)); }, param);
+    if (hasRows)
+      st.exchange(into(entry->r));
+    st.define_and_bind();
+
+    return *(entries[key] = std::move(entry));
+  }
+
+  void drop(connection_pool &pool, size_t position, const string &sql,
+            const vector<StatementParam> &params) {
+    entriesOf(pool, position).erase(keyOf(sql, params));
+  }
+};
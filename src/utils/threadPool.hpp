@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// A fixed size pool of worker threads.
+class ThreadPool {
+public:
+  ThreadPool(size_t size) {
+    for (size_t i = 0; i < max<size_t>(size, 1); i++)
+      workers.emplace_back([this] { work(); });
+  }
+
+  ~ThreadPool() {
+    unique_lock<std::mutex> guard(mutex);
+    stopped = true;
+    guard.unlock();
+
+    condition.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  // Run the task on one of the workers.
+  // The returned future will hold the result or the thrown exception.
+  template <typename F> future<invoke_result_t<F>> submit(F &&task) {
+    auto packaged =
+        make_shared<packaged_task<invoke_result_t<F>()>>(std::forward<F>(task));
+    future<invoke_result_t<F>> result = packaged->get_future();
+
+    unique_lock<std::mutex> guard(mutex);
+    tasks.push([packaged] { (*packaged)(); });
+    guard.unlock();
+
+    condition.notify_one();
+    return result;
+  }
+
+  // The number of workers.
+  size_t size() const { return workers.size(); }
+
+private:
+  vector<thread> workers;
+  queue<function<void()>> tasks;
+  std::mutex mutex;
+  condition_variable condition;
+  bool stopped = false;
+
+  void work() {
+    while (true) {
+      unique_lock<std::mutex> guard(mutex);
+      condition.wait(guard, [this] { return stopped || !tasks.empty(); });
+      if (stopped && tasks.empty())
+        return;
+
+      function<void()> task = std::move(tasks.front());
+      tasks.pop();
+      guard.unlock();
+
+      task();
+    }
+  }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// A thread-safe token bucket that limits the rate of requests.
+// The bucket is refilled continuously at the given rate and holds at most
+// burst tokens.
+class TokenBucket {
+public:
+  TokenBucket(double ratePerSecond, double burst = 1)
+      : rate(ratePerSecond), burst(max(burst, 1.0)), tokens(this->burst),
+        updated(chrono::steady_clock::now()) {}
+
+  // Take a token, waiting until one is available.
+  void acquire() {
+    while (true) {
+      chrono::duration<double> wait = reserve();
+      if (wait.count() <= 0)
+        return;
+
+      this_thread::sleep_for(wait);
+    }
+  }
+
+  // Take a token if one is available now.
+  bool tryAcquire() { return reserve().count() <= 0; }
+
+private:
+  std::mutex mutex;
+  double rate;
+  double burst;
+  double tokens;
+  chrono::steady_clock::time_point updated;
+
+  // Take a token and return 0, or return how long to wait for the next one.
+  chrono::duration<double> reserve() {
+    lock_guard<std::mutex> guard(mutex);
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - updated).count();
+    tokens = min(burst, tokens + elapsed * rate);
+    updated = now;
+
+    if (tokens >= 1) {
+      tokens -= 1;
+      return chrono::duration<double>(0);
+    }
+
+    return chrono::duration<double>((1 - tokens) / rate);
+  }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// An inverted index from the trigrams of the given strings to their positions.
+// The trigrams are taken over UTF-8 code points, and every string is padded so
+// that short strings and keywords can also be indexed.
+class TrigramIndex {
+public:
+  // Rebuild the index from the given strings.
+  void build(const vector<string> &strings) {
+    postings.clear();
+    size = strings.size();
+
+    for (uint32_t i = 0; i < strings.size(); i++)
+      for (const uint64_t &gram : trigrams(strings[i]))
+        // the trigrams are unique, so the positions are sorted and unique
+        postings[gram].push_back(i);
+  }
+
+  // Return the positions of the strings sharing at least one trigram with the
+  // given keyword, in ascending order.
+  vector<uint32_t> candidates(const string &keyword) const {
+    vector<uint32_t> result;
+
+    for (const uint64_t &gram : trigrams(keyword)) {
+      auto it = postings.find(gram);
+      if (it == postings.end())
+        continue;
+
+      vector<uint32_t> merged;
+      merged.reserve(result.size() + it->second.size());
+      set_union(result.begin(), result.end(), it->second.begin(),
+                it->second.end(), back_inserter(merged));
+      result.swap(merged);
+
+      // every string is a candidate, no need to continue
+      if (result.size() == size)
+        break;
+    }
+
+    return result;
+  }
+
+  // Return true if the keyword has a trigram of its own code points, i.e. it
+  // has 3 code points or more. The candidates of a shorter keyword only share
+  // its padded trigrams, so they only start or end with it.
+  static bool isSelective(const string &keyword) {
+    return codePoints(keyword).size() >= 3;
+  }
+
+private:
+  unordered_map<uint64_t, vector<uint32_t>> postings;
+  size_t size = 0;
+
+  // Decode the string into code points. Invalid bytes are kept as it is.
+  static vector<uint32_t> codePoints(const string &s) {
+    vector<uint32_t> result;
+    result.reserve(s.size());
+
+    size_t i = 0;
+    while (i < s.size()) {
+      unsigned char c = s[i];
+      int length = c < 0x80           ? 1
+                   : (c >> 5) == 0x6  ? 2
+                   : (c >> 4) == 0xE  ? 3
+                   : (c >> 3) == 0x1E ? 4
+                                      : 1;
+
+      if (i + length > s.size())
+        length = 1;
+
+      uint32_t cp = length == 1 ? c : c & (0x7F >> length);
+      for (int j = 1; j < length; j++)
+        cp = (cp << 6) | (s[i + j] & 0x3F);
+
+      result.push_back(cp);
+      i += length;
+    }
+
+    return result;
+  }
+
+  // Return the unique trigrams of the string, each packed into an integer.
+  static vector<uint64_t> trigrams(const string &s) {
+    // pad with two leading and one trailing zero like pg_trgm
+    vector<uint32_t> cps = {0, 0};
+    vector<uint32_t> decoded = codePoints(s);
+    if (decoded.empty())
+      return {};
+
+    cps.insert(cps.end(), decoded.begin(), decoded.end());
+    cps.push_back(0);
+
+    vector<uint64_t> result;
+    result.reserve(cps.size() - 2);
+    for (size_t i = 0; i + 2 < cps.size(); i++)
+      result.push_back(((uint64_t)cps[i] << 42) | ((uint64_t)cps[i + 1] << 21) |
+                       cps[i + 2]);
+
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+
+    return result;
+  }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+using namespace std;
+
+// The weight of the latest interval in the estimated interval.
+#define UPDATE_POLLER_ALPHA 0.3
+
+// This class schedules the polls of an upstream whose update frequency is
+// unknown.
+// It estimates the interval between the changes with an exponentially
+// weighted moving average, and polls twice within the estimated interval.
+// The failed polls are retried with an exponential backoff and jitter.
+// All the times are in seconds.
+class UpdatePoller {
+public:
+  UpdatePoller(int minInterval, int maxInterval, int initialInterval)
+      : minInterval(max(minInterval, 1)),
+        maxInterval(max(maxInterval, minInterval)),
+        estimatedInterval(initialInterval) {}
+
+  // Whether it is time to poll.
+  bool isDue() {
+    lock_guard<std::mutex> guard(mutex);
+    return now() >= nextPoll;
+  }
+
+  // Record a successful poll and schedule the next one.
+  void succeeded(bool changed) {
+    lock_guard<std::mutex> guard(mutex);
+    long long current = now();
+    failures = 0;
+
+    if (changed) {
+      if (lastChange > 0)
+        estimatedInterval =
+            UPDATE_POLLER_ALPHA * (current - lastChange) +
+            (1 - UPDATE_POLLER_ALPHA) * estimatedInterval;
+
+      lastChange = current;
+    }
+
+    // the upstream has been quiet for longer than expected, slow down
+    double interval = estimatedInterval;
+    if (lastChange > 0)
+      interval = max(interval, (double)(current - lastChange));
+
+    // poll twice within the interval so the lag stays under half of it, with
+    // a small jitter so the drivers don't poll in lockstep
+    double delay = clamp(interval / 2, (double)minInterval,
+                         (double)maxInterval);
+    schedule(current, delay * uniform_real_distribution<>(0.9, 1.1)(random));
+  }
+
+  // Record a failed poll and back off.
+  void failed() {
+    lock_guard<std::mutex> guard(mutex);
+    failures++;
+
+    // full jitter over the upper half of the backoff
+    double delay = min<double>(maxInterval,
+                               minInterval * pow(2, min(failures, 16) - 1));
+    schedule(now(), delay * uniform_real_distribution<>(0.5, 1)(random));
+  }
+
+  // The time of the next poll since the epoch.
+  long long getNextPoll() {
+    lock_guard<std::mutex> guard(mutex);
+    return nextPoll;
+  }
+
+  double getEstimatedInterval() {
+    lock_guard<std::mutex> guard(mutex);
+    return estimatedInterval;
+  }
+
+  // The number of consecutive failed polls.
+  int getFailures() {
+    lock_guard<std::mutex> guard(mutex);
+    return failures;
+  }
+
+private:
+  std::mutex mutex;
+  int minInterval;
+  int maxInterval;
+  double estimatedInterval;
+  long long lastChange = 0;
+  long long nextPoll = 0;
+  int failures = 0;
+  mt19937 random{random_device{}()};
+
+  static long long now() {
+    return chrono::duration_cast<chrono::seconds>(
+               chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void schedule(long long current, double delay) {
+    nextPoll = current + max<long long>(llround(delay), 1);
+  }
+};